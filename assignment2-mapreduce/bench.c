@@ -0,0 +1,227 @@
+/**
+ * bench.c - Throughput benchmark of the MapReduce library (make bench)
+ *
+ * Runs the word count of distwc.c over the given files for every
+ * combination of worker and partition counts, each run in a fresh child
+ * process so peak RSS is per configuration. Reports the best wall time
+ * of the repeats as MB/s of input and pairs/s (pairs = words emitted,
+ * taken from the result counts), plus the peak RSS over the repeats.
+ *
+ * Usage: bench_driver [-w "1 2 4"] [-p "1 10"] [-r repeats] [-c] file...
+ *     -c  Use distwc's combiner (as ./wordcount does); default is plain MR_Run
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "mapreduce.h"
+
+// Word count callbacks (distwc.c, its main renamed away)
+void Map(char* file_name);
+void Reduce(char* key, unsigned int partition_idx);
+void Combine(char* key, char* acc, char* value);
+
+// Largest number of values in a -w or -p list
+#define MAX_SWEEP 32
+
+/**
+ * parse_list - Parse a space or comma separated list of positive integers
+ * @return: Number of values stored, 0 if the list is invalid
+ */
+static unsigned int parse_list(const char* text, unsigned int* values) {
+    unsigned int count = 0;
+    while (*text != '\0') {
+        char* end;
+        unsigned long v = strtoul(text, &end, 10);
+        if (end == text || v == 0 || count == MAX_SWEEP) {
+            return 0;
+        }
+        values[count++] = (unsigned int)v;
+        text = end;
+        while (*text == ' ' || *text == ',') {
+            text++;
+        }
+    }
+    return count;
+}
+
+/**
+ * run_once - Run one configuration in a child process
+ *
+ * @param seconds: Set to the wall time of MR_RunEx in the child
+ * @param rss_kb: Set to the child's peak resident set in KB
+ * @return: 0 on success, -1 if the child failed
+ */
+static int run_once(int file_count, char** files, unsigned int workers, unsigned int parts,
+                    int combine, const char* pattern, double* seconds, long* rss_kb) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        MR_Options options = { .combiner = combine ? Combine : NULL,
+                               .output_pattern = pattern };
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        MR_RunEx(file_count, files, Map, Reduce, workers, parts, &options);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        ssize_t n = write(fds[1], &elapsed, sizeof(elapsed));
+        _exit(n == (ssize_t)sizeof(elapsed) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t n = read(fds[0], seconds, sizeof(*seconds));
+    close(fds[0]);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0 || n != (ssize_t)sizeof(*seconds)) {
+        fprintf(stderr, "bench: run with %u workers, %u partitions failed\n", workers, parts);
+        return -1;
+    }
+    *rss_kb = usage.ru_maxrss;
+    return 0;
+}
+
+/**
+ * collect_results - Sum the counts in the result files and remove them
+ * @return: Total count, i.e. the number of pairs emitted
+ */
+static unsigned long long collect_results(const char* pattern, unsigned int parts) {
+    unsigned long long total = 0;
+    char* line = NULL;
+    size_t size = 0;
+
+    for (unsigned int p = 0; p < parts; p++) {
+        char path[4096];
+        snprintf(path, sizeof(path), pattern, p);
+        FILE* fp = fopen(path, "r");
+        if (fp == NULL) {
+            continue;  // Partition received no keys
+        }
+        while (getline(&line, &size, fp) != -1) {
+            // "<key>: <count>"; the key may itself contain a ':'
+            char* sep = strrchr(line, ':');
+            if (sep != NULL) {
+                total += strtoull(sep + 1, NULL, 10);
+            }
+        }
+        fclose(fp);
+        unlink(path);
+    }
+    free(line);
+    return total;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-w \"1 2 4\"] [-p \"1 10\"] [-r repeats] [-c] file...\n", prog);
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int workers[MAX_SWEEP] = { 1, 2, 4, 8 };
+    unsigned int worker_count = 4;
+    unsigned int parts[MAX_SWEEP] = { 1, 4, 10 };
+    unsigned int part_count = 3;
+    unsigned int repeats = 3;
+    int combine = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "w:p:r:c")) != -1) {
+        switch (opt) {
+            case 'w': worker_count = parse_list(optarg, workers); break;
+            case 'p': part_count = parse_list(optarg, parts); break;
+            case 'r': repeats = strtoul(optarg, NULL, 10); break;
+            case 'c': combine = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind >= argc || worker_count == 0 || part_count == 0 || repeats == 0) {
+        usage(argv[0]);
+    }
+
+    char** files = &argv[optind];
+    int file_count = argc - optind;
+    unsigned long long bytes = 0;
+    for (int i = 0; i < file_count; i++) {
+        struct stat st;
+        if (stat(files[i], &st) != 0) {
+            perror(files[i]);
+            return 1;
+        }
+        bytes += st.st_size;
+    }
+
+    // Results go to a scratch directory, not the caller's result-*.txt
+    char scratch[] = "/tmp/mr-bench-XXXXXX";
+    if (mkdtemp(scratch) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char pattern[sizeof(scratch) + 32];
+    snprintf(pattern, sizeof(pattern), "%s/result-%%d.txt", scratch);
+
+    double mb = bytes / (1024.0 * 1024.0);
+    printf("# %d files, %.1f MB, %s, best of %u\n", file_count, mb,
+           combine ? "combiner" : "MR_Run", repeats);
+    printf("%7s %6s %9s %9s %10s %12s\n",
+           "workers", "parts", "seconds", "MB/s", "Mpairs/s", "peak_rss_MB");
+
+    unsigned long long pairs = 0;
+    int status = 0;
+    for (unsigned int w = 0; w < worker_count; w++) {
+        for (unsigned int p = 0; p < part_count; p++) {
+            double best = 0;
+            long peak = 0;
+            for (unsigned int r = 0; r < repeats; r++) {
+                double seconds;
+                long rss_kb;
+                if (run_once(file_count, files, workers[w], parts[p], combine, pattern,
+                             &seconds, &rss_kb) != 0) {
+                    status = 1;
+                    break;
+                }
+                // Every configuration must count the same words
+                unsigned long long counted = collect_results(pattern, parts[p]);
+                if (pairs == 0) {
+                    pairs = counted;
+                } else if (counted != pairs) {
+                    fprintf(stderr, "bench: %u workers, %u partitions counted %llu "
+                            "pairs, expected %llu\n", workers[w], parts[p], counted, pairs);
+                    status = 1;
+                }
+                if (r == 0 || seconds < best) {
+                    best = seconds;
+                }
+                if (rss_kb > peak) {
+                    peak = rss_kb;
+                }
+            }
+            if (best > 0) {
+                printf("%7u %6u %9.3f %9.2f %10.3f %12.1f\n", workers[w], parts[p],
+                       best, mb / best, pairs / best / 1e6, peak / 1024.0);
+                fflush(stdout);
+            }
+        }
+    }
+
+    rmdir(scratch);
+    return status;
+}
@@ -4,35 +4,116 @@
 #include <string.h>
 #include "mapreduce.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Bytes that end a token: strsep's " \t\n\r", plus '\0' where strsep
+// stops reading the line
+static inline int is_delim(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\0';
+}
+
+// Index of the first delimiter in data[pos, len), or len if there is none
+static size_t next_delim(const char* data, size_t pos, size_t len) {
+#ifdef __SSE2__
+    // 16 bytes per step: compare against every delimiter, OR the masks
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i nul = _mm_setzero_si128();
+    while (pos + 16 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + pos));
+        __m128i hit = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, cr)),
+                         _mm_cmpeq_epi8(v, nul)));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+#endif
+    // Scalar tail (and fallback for targets without SSE2)
+    while (pos < len && !is_delim(data[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+// Emit every token of data[0, len) exactly as getline + strsep would,
+// including the empty tokens around adjacent delimiters and line ends
+static void emit_tokens(const char* data, size_t len) {
+    size_t start = 0;
+    while (start < len) {
+        size_t end = next_delim(data, start, len);
+        MR_EmitN(data + start, end - start, "1");
+        if (end == len) {
+            return;  // Last line without a '\n'
+        }
+        if (data[end] == '\n') {
+            MR_EmitN(data + end, 0, "1");  // strsep's token after the '\n'
+        } else if (data[end] == '\0') {
+            // strsep sees the end of the string: skip the rest of the line
+            const char* eol = memchr(data + end, '\n', len - end);
+            if (eol == NULL) {
+                return;
+            }
+            end = eol - data;
+        }
+        start = end + 1;
+    }
+    // A last line ending in ' ', '\t' or '\r' has one more empty token
+    if (len > 0 && data[len - 1] != '\n') {
+        MR_EmitN(data + len, 0, "1");
+    }
+}
+
 void Map(char* file_name) {
-    FILE* fp = fopen(file_name, "r");
-    assert(fp != NULL);
+    MR_Input* input = MR_InputOpen(file_name);
+    assert(input != NULL);
 
+    size_t length;
+    const char* data = MR_InputMap(input, &length);
+    if (data != NULL) {
+        emit_tokens(data, length);
+        MR_InputClose(input);
+        return;
+    }
+
+    // Not mappable (e.g. a pipe): read line by line
     char* line = NULL;
     size_t size = 0;
-    while (getline(&line, &size, fp) != -1) {
+    while (MR_InputGetline(&line, &size, input) != -1) {
         char *token, *dummy = line;
         while ((token = strsep(&dummy, " \t\n\r")) != NULL) {
             MR_Emit(token, "1");
         }
     }
     free(line);
-    fclose(fp);
+    MR_InputClose(input);
+}
+
+// Keep a running count per word instead of a list of "1"s
+void Combine(char* key, char* acc, char* value) {
+    snprintf(acc, MR_COMBINE_VALUE_MAX, "%d", atoi(acc) + atoi(value));
 }
 
 void Reduce(char* key, unsigned int partition_idx) {
     int count = 0;
-    char *value, name[100];
-    while ((value = MR_GetNext(key, partition_idx)) != NULL) {
-        count++;
-        free(value);
+    const char* value;
+    char total[MR_COMBINE_VALUE_MAX];
+    while ((value = MR_GetNextView(key, partition_idx, NULL)) != NULL) {
+        count += atoi(value);
     }
-    sprintf(name, "result-%d.txt", partition_idx);
-    FILE* fp = fopen(name, "a");
-    fprintf(fp, "%s: %d\n", key, count);
-    fclose(fp);
+    snprintf(total, sizeof(total), "%d", count);
+    MR_Output(partition_idx, key, total);
 }
 
 int main(int argc, char *argv[]) {
-    MR_Run(argc - 1, &(argv[1]), Map, Reduce, 5, 10);
+    MR_Options options = { .combiner = Combine };
+    MR_RunEx(argc - 1, &(argv[1]), Map, Reduce, 5, 10, &options);
+    return 0;
 }
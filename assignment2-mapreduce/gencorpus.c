@@ -0,0 +1,182 @@
+/**
+ * gencorpus.c - Synthetic word-count corpus generator (make bench)
+ *
+ * Writes N text files of about S bytes in total. Words are drawn from a
+ * vocabulary of V distinct words with Zipf-distributed frequencies
+ * (rank r has weight 1 / r^z; z = 0 is uniform), separated by spaces,
+ * with a line break every few words. Output is deterministic per seed.
+ *
+ * Usage: gencorpus [-d dir] [-n files] [-s size[K|M|G]] [-v vocab]
+ *                  [-z skew] [-S seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Bytes per fwrite batch
+#define WRITE_BUFFER_BYTES (64 * 1024)
+
+static unsigned long long rng_state = 88172645463325252ull;
+
+/**
+ * next_random - xorshift64* generator
+ */
+static unsigned long long next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+/**
+ * parse_size - Parse a byte count with an optional K, M or G suffix
+ * @return: Bytes, or 0 if the string is not a size
+ */
+static unsigned long long parse_size(const char* text) {
+    char* end;
+    double value = strtod(text, &end);
+    if (end == text || value <= 0) {
+        return 0;
+    }
+    switch (*end) {
+        case 'k': case 'K': value *= 1024; end++; break;
+        case 'm': case 'M': value *= 1024 * 1024; end++; break;
+        case 'g': case 'G': value *= 1024.0 * 1024 * 1024; end++; break;
+        default: break;
+    }
+    return (*end == '\0') ? (unsigned long long)value : 0;
+}
+
+/**
+ * make_word - Spell the word of a vocabulary rank
+ *
+ * The rank in base 25 ('a'..'y'), a 'z', then padding up to a length of
+ * 2..11 picked from a hash of the rank. Letters before the 'z' identify
+ * the rank, so words are distinct and frequent ones are not all short.
+ */
+static size_t make_word(unsigned long rank, char* word) {
+    unsigned long mix = (rank + 1) * 2654435761ul;
+    size_t length = 2 + (mix >> 7) % 10;
+    size_t n = 0;
+
+    unsigned long digits = rank;
+    do {
+        word[n++] = 'a' + digits % 25;
+        digits /= 25;
+    } while (digits > 0);
+    word[n++] = 'z';
+    while (n < length) {
+        word[n] = 'a' + (mix >> (3 * n)) % 25;
+        n++;
+    }
+    word[n] = '\0';
+    return n;
+}
+
+/**
+ * zipf_rank - Draw a vocabulary rank from the cumulative weights
+ */
+static unsigned long zipf_rank(const double* cdf, unsigned long vocab) {
+    double u = (next_random() >> 11) * (1.0 / 9007199254740992.0) * cdf[vocab - 1];
+    unsigned long lo = 0, hi = vocab - 1;
+    while (lo < hi) {
+        unsigned long mid = lo + (hi - lo) / 2;
+        if (cdf[mid] < u) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-d dir] [-n files] [-s size[K|M|G]] [-v vocab] "
+            "[-z skew] [-S seed]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    const char* dir = "bench-corpus";
+    unsigned long files = 8;
+    unsigned long long total = 64ull * 1024 * 1024;
+    unsigned long vocab = 50000;
+    double skew = 1.0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:n:s:v:z:S:")) != -1) {
+        switch (opt) {
+            case 'd': dir = optarg; break;
+            case 'n': files = strtoul(optarg, NULL, 10); break;
+            case 's': total = parse_size(optarg); break;
+            case 'v': vocab = strtoul(optarg, NULL, 10); break;
+            case 'z': skew = strtod(optarg, NULL); break;
+            case 'S': rng_state = strtoull(optarg, NULL, 10) | 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (files == 0 || total == 0 || vocab == 0 || skew < 0) {
+        usage(argv[0]);
+    }
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        perror(dir);
+        return 1;
+    }
+
+    // Cumulative Zipf weights over ranks 1..vocab
+    double* cdf = (double*)malloc(vocab * sizeof(double));
+    double sum = 0;
+    for (unsigned long r = 0; r < vocab; r++) {
+        sum += 1.0 / pow((double)(r + 1), skew);
+        cdf[r] = sum;
+    }
+
+    char* buffer = (char*)malloc(WRITE_BUFFER_BYTES + 32);
+    unsigned long long per_file = total / files;
+    for (unsigned long f = 0; f < files; f++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/corpus%lu.txt", dir, f);
+        FILE* fp = fopen(path, "w");
+        if (fp == NULL) {
+            perror(path);
+            return 1;
+        }
+
+        // Last file takes the remainder
+        unsigned long long target = (f + 1 == files) ? total - per_file * f : per_file;
+        unsigned long long written = 0;
+        size_t used = 0;
+        unsigned int words_on_line = 0;
+        unsigned int line_words = 8 + next_random() % 8;
+        while (written + used < target) {
+            used += make_word(zipf_rank(cdf, vocab), buffer + used);
+            if (++words_on_line == line_words) {
+                buffer[used++] = '\n';
+                words_on_line = 0;
+                line_words = 8 + next_random() % 8;
+            } else {
+                buffer[used++] = ' ';
+            }
+            if (used >= WRITE_BUFFER_BYTES) {
+                fwrite(buffer, 1, used, fp);
+                written += used;
+                used = 0;
+            }
+        }
+        fwrite(buffer, 1, used, fp);
+        if (fclose(fp) != 0) {
+            perror(path);
+            return 1;
+        }
+    }
+
+    free(buffer);
+    free(cdf);
+    return 0;
+}
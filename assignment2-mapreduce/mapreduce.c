@@ -3,13 +3,15 @@
  * 
  * This library implements a single-system MapReduce framework with:
  * - Partitioned intermediate storage (P partitions)
- * - Concurrent key-value emission with sorted keys
+ * - Concurrent key-value emission into hash-indexed partitions
  * - Iterator-based value retrieval for Reduce phase
- * - DJB2 hash-based partitioning
+ * - DJB2 hash-based partitioning (pluggable, optionally skew-balanced)
+ * - Opt-in run statistics (phase times, worker and lock waits) as JSON
+ * - Optional pinned workers with partition storage on the reducer's NUMA node
  * 
  * Architecture:
  * - Map phase: Parallel processing of files
- * - Shuffle: Automatic (keys sorted within partitions)
+ * - Shuffle: Keys sorted once per partition at the start of its Reduce
  * - Reduce phase: Parallel processing of partitions
  */
 
@@ -19,56 +21,196 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
 
 /**
  * Data Structures for Intermediate Storage
  */
 
+// Chunk of a bump allocator; chunks are chained and freed together
+typedef struct Arena_chunk {
+    struct Arena_chunk* next;       // Previously filled chunk
+    size_t used;                    // Bytes handed out from data
+    size_t capacity;                // Usable bytes in data
+    char data[];                    // Storage (flexible array member)
+} Arena_chunk;
+
+// Bump arena: no per-object free, whole arena released at once
+typedef struct {
+    Arena_chunk* head;              // Chunk currently being filled
+    size_t allocated;               // Bytes of all chunks (for the memory budget)
+    int node;                       // NUMA node new chunks are bound to (-1 = any)
+} Arena;
+
+// Default arena chunk size (larger requests get a dedicated chunk)
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
 // Single value in a value list
 typedef struct Value_node {
-    char* value;                    // Dynamically allocated string
+    char* value;                    // String in the partition arena
+    size_t length;                  // strlen(value), for MR_GetNextView
     struct Value_node* next;        // Next value for same key
 } Value_node;
 
 // Key entry with associated values
 typedef struct Key_entry {
-    char* key;                      // Dynamically allocated string (sorted)
+    char* key;                      // String in the partition arena
+    unsigned long hash;             // Cached key_hash of key (for rehashing)
     Value_node* values;             // Linked list of values for this key
     Value_node* values_tail;        // Tail pointer for O(1) append
-    struct Key_entry* next;         // Next key in sorted order
+    unsigned long value_count;      // Values in the list (for MR_GetCount)
+    struct Key_entry* next;         // Next key (insertion order, sorted after sort_partition_keys)
 } Key_entry;
 
+// Buffered result file of one partition, written by its reducer only
+typedef struct {
+    int fd;                         // Result file, -1 until first MR_Output, -2 if open failed
+    char* buffer;                   // OUTPUT_BUFFER_BYTES of pending output
+    size_t used;                    // Bytes pending in buffer
+} Output_sink;
+
+// Bytes of result output buffered per partition before a write(2)
+#define OUTPUT_BUFFER_BYTES (64 * 1024)
+
+// Records at least this long bypass the buffer (sent with writev)
+#define OUTPUT_DIRECT_BYTES (OUTPUT_BUFFER_BYTES / 4)
+
 // Partition: stores subset of key-value pairs
 typedef struct {
-    Key_entry* head;                // Sorted linked list of keys
-    pthread_mutex_t partition_mutex; // Protects concurrent access
+    Key_entry* head;                // Linked list of keys (sorted before Reduce)
+    Key_entry* sorted_keys;         // Sorted suffix of head (see sort_partition_keys)
+    unsigned int unsorted_count;    // Keys in front of sorted_keys
+    int reducing;                   // Set once MR_Reduce owns the partition
+    Key_entry** table;              // Open-addressing hash index over keys
+    unsigned int table_capacity;    // Number of slots in table (power of two)
+    Arena arena;                    // Owns all keys, values and nodes of this partition
+    pthread_mutex_t partition_mutex; // Protects concurrent access (incl. arena)
     unsigned int key_count;         // Number of distinct keys
     unsigned long total_pairs;      // Total key-value pairs (for SJF)
+    FILE** runs;                    // Sorted run files spilled by partition_spill
+    unsigned int run_count;         // Entries in runs
+    int spill_failed;               // A run could not be written: stay in memory
+    unsigned long long lock_wait_ns; // Stats: time Map threads blocked on partition_mutex
+    unsigned long lock_contended;   // Stats: acquisitions that had to block
 } Partition;
 
-// Iterator state for MR_GetNext (one per partition)
+// Initial hash table size per partition; grown by doubling at 50% load
+#define PARTITION_TABLE_INIT 64
+
+// Pairs staged per partition by a Map thread before a batched flush
+#define EMIT_BUFFER_PAIRS 256
+
+// Slots in a staging buffer's key index (power of two, 2x pairs)
+#define EMIT_BUFFER_SLOTS 512
+
+// Scratch bytes per staging buffer for copied key/value strings
+#define EMIT_BUFFER_BYTES 8192
+
+// Pair emitted by a mapper but not yet merged into its partition
+typedef struct {
+    char* key;                      // Copy of key in the buffer's scratch space
+    char* value;                    // Copy of value in the buffer's scratch space
+    unsigned long hash;             // key_hash of key
+} Staged_pair;
+
+// Thread-local staging buffer for one partition (no locking needed)
+typedef struct {
+    Staged_pair pairs[EMIT_BUFFER_PAIRS];
+    unsigned int count;             // Number of staged pairs
+    size_t bytes_used;              // Bytes used in strings
+    unsigned short index[EMIT_BUFFER_SLOTS]; // Combiner only: pair idx + 1 per key slot
+    char strings[EMIT_BUFFER_BYTES]; // Scratch space, reused after every flush
+} Emit_buffer;
+
+// Iterator state for MR_GetNext (one per reducing thread)
 typedef struct {
+    unsigned int partition_idx;     // Partition of current_key
     Key_entry* current_key;         // Current key being iterated
     Value_node* current_value;      // Current position in value list
 } IteratorState;
 
 /**
- * Global State
+ * MR_Context - Everything one MapReduce run works on
+ * 
+ * The pool and the partition storage outlive a run so the next
+ * MR_RunCtx starts with warm threads and arenas. Nothing is static:
+ * contexts are independent and may run concurrently.
  */
-static Partition* partitions = NULL;        // Array of P partitions
-static unsigned int num_partitions = 0;     // P (number of partitions)
-static ThreadPool_t* global_threadpool = NULL; // Shared thread pool
-static IteratorState* iterators = NULL;     // Iterator state per partition
+struct MR_Context {
+    ThreadPool_t* threadpool;       // Persistent worker pool
+    unsigned int num_workers;       // Threads in threadpool
+    ThreadPool_policy_t policy;     // Scheduling policy of threadpool
+    unsigned int bucket_capacity;   // Partitions allocated (kept between runs)
+    unsigned int output_capacity;   // Output sinks allocated (kept between runs)
+    
+    // Current run
+    Partition* partitions;          // Storage partitions (buckets)
+    unsigned int num_partitions;    // P (number of partitions / reducers)
+    unsigned int num_buckets;       // Entries in partitions used (P * balance)
+    unsigned int* bucket_owner;     // Reducer of each bucket (assign_buckets)
+    Output_sink* outputs;           // MR_Output sink of each of the P partitions
+    Partitioner user_partitioner;   // MR_Options.partitioner of this run
+    int use_fast_hash;              // MR_Options.fast_hash of this run
+    Combiner active_combiner;       // MR_Options.combiner of this run
+    const char* output_pattern;     // File name format of MR_Output
+    size_t spill_limit;             // Arena bytes per partition before a spill (0 = never)
+    const char* spill_dir;          // Directory for run files
+    const char* stats_path;         // Run statistics destination (NULL = off)
+    unsigned long long map_end_ns;  // Stats: when the last Map job finished
+    
+    // Placement (MR_Options.pin_workers): reducer p is queued on worker
+    // p % num_workers and its buckets are allocated on that worker's node
+    int pin_workers;                // Workers are pinned; Reduce jobs get a home worker
+    int numa_placement;             // Workers span several nodes: bind arenas
+    
+    // Pipelined runs (MR_Options.pipeline): the Map job that finishes last
+    // queues the Reduce jobs itself, and the first Map job to leave a worker
+    // idle queues a pre-sort of every partition
+    int pipeline_enabled;
+    atomic_uint maps_pending;       // Map jobs not finished yet
+    unsigned int presort_trigger;   // maps_pending value that starts pre-sorting
+    Reducer active_reducer;
+};
+
+// Context the calling thread works for: set by every Map/Reduce job and
+// by MR_RunCtx in its caller, since the callbacks carry no context
+static __thread MR_Context* ctx = NULL;
+
+// Staging buffers of the calling thread (one per partition), only set
+// while that thread is running an MR_Map job
+static __thread Emit_buffer* emit_buffers = NULL;
+
+// Value cursor of the calling thread, positioned by MR_Reduce before
+// each reducer call
+static __thread IteratorState reduce_iter;
 
 /**
  * Arguments for Map and Reduce tasks
  */
 typedef struct {
+    MR_Context* ctx;        // Run the job belongs to
     char* filename;
     Mapper mapper_func;
+    off_t offset;           // First byte of this job's range
+    off_t length;           // Bytes in the range, -1 for the whole file
 } MapArgs;
 
+// MapArgs of the MR_Map job the calling thread is running, read by
+// MR_InputOpen to find the job's byte range
+static __thread const MapArgs* current_map = NULL;
+
 typedef struct {
+    MR_Context* ctx;        // Run the job belongs to
     unsigned int partition_idx;
     Reducer reducer_func;
 } ReduceArgs;
@@ -79,407 +221,2320 @@ typedef struct {
 typedef struct {
     char* filename;
     unsigned long size;
+    off_t offset;           // Range inside the file (see plan_splits)
+    off_t length;
 } FileInfo;
 
+// Reader handed out by MR_InputOpen
+struct MR_Input {
+    FILE* fp;
+    off_t remaining;        // Bytes left in the range, -1 for no limit
+    void* map;              // Mapping made by MR_InputMap, NULL if none
+    size_t map_length;
+};
+
 typedef struct {
     unsigned int partition_idx;
     unsigned long size;
 } PartitionInfo;
 
 /**
- * MR_Partitioner - Hash function to determine partition for a key
+ * arena_chunk_on_node - Allocate a page-aligned chunk bound to a NUMA node
  * 
- * @param key: Key string
- * @param num_partitions: Total number of partitions (P)
- * @return: Partition index [0, P-1]
+ * @param capacity: Usable bytes needed
+ * @param node: Node the chunk's pages should come from
+ * @param actual: Set to the usable bytes (rounded up to whole pages)
+ * @return: New chunk (free() releases it)
  * 
- * Uses DJB2 hash algorithm:
- * - Fast single-pass computation
- * - Good distribution (avoids clustering)
- * - Deterministic (same key always maps to same partition)
+ * The binding is MPOL_PREFERRED, set before the pages are first touched
+ * (by whichever mapper emits into the partition). mbind is called
+ * directly so the library does not need libnuma; if it fails the chunk
+ * simply follows the default first-touch placement.
  */
-unsigned int MR_Partitioner(char* key, unsigned int num_partitions) {
-    unsigned long hash = 5381;
-    int c;
+static Arena_chunk* arena_chunk_on_node(size_t capacity, int node, size_t* actual) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t length = (sizeof(Arena_chunk) + capacity + page - 1) & ~(page - 1);
+    
+    void* mem = NULL;
+    if (posix_memalign(&mem, page, length) != 0) {
+        *actual = capacity;
+        return (Arena_chunk*)malloc(sizeof(Arena_chunk) + capacity);
+    }
     
-    // DJB2 hash: hash = hash * 33 + c
-    while ((c = *key++) != '\0') {
-        hash = ((hash << 5) + hash) + c;  // hash * 33 + c
+    unsigned long mask[4] = { 0 };  // Nodes 0..255
+    if (node < (int)(sizeof(mask) * CHAR_BIT)) {
+        mask[node / (sizeof(unsigned long) * CHAR_BIT)] |=
+            1ul << (node % (sizeof(unsigned long) * CHAR_BIT));
+        syscall(SYS_mbind, mem, length, MPOL_PREFERRED, mask, sizeof(mask) * CHAR_BIT, 0);
     }
     
-    return hash % num_partitions;
+    *actual = length - sizeof(Arena_chunk);
+    return (Arena_chunk*)mem;
 }
 
 /**
- * MR_Emit - Emit a key-value pair to intermediate storage
- * 
- * @param key: Key string (will be duplicated)
- * @param value: Value string (will be duplicated)
- * 
- * Process:
- * 1. Determine partition using MR_Partitioner
- * 2. Lock partition mutex
- * 3. Search for key in sorted key list
- * 4. If key exists: append value to value list
- * 5. If key doesn't exist: insert new key entry (maintain sort order)
- * 6. Unlock partition mutex
+ * arena_alloc - Allocate bytes from an arena
  * 
- * Synchronization:
- * - Partition-level locking (finer-grained than global lock)
- * - Multiple threads can write to different partitions concurrently
- * - Sorted insertion maintains key ordering
+ * @param arena: Arena to allocate from
+ * @param size: Number of bytes needed
+ * @return: 8-byte aligned pointer valid until arena_release
  * 
- * Memory:
- * - Duplicates both key and value (caller may reuse buffers)
- * - Freed during partition cleanup in MR_Run
+ * Synchronization: caller serializes access (partition_mutex)
  */
-void MR_Emit(char* key, char* value) {
-    // Determine target partition
-    unsigned int p = MR_Partitioner(key, num_partitions);
-    
-    // Duplicate strings (caller may reuse their buffers)
-    char* key_copy = strdup(key);
-    char* value_copy = strdup(value);
-    
-    // CRITICAL SECTION: Modify partition
-    pthread_mutex_lock(&partitions[p].partition_mutex);
-    
-    // Search for key in sorted list (using strcmp for lexicographic order)
-    Key_entry* prev = NULL;
-    Key_entry* curr = partitions[p].head;
-    
-    while (curr != NULL && strcmp(curr->key, key_copy) < 0) {
-        prev = curr;
-        curr = curr->next;
-    }
+static void* arena_alloc(Arena* arena, size_t size) {
+    size = (size + 7) & ~(size_t)7;  // Keep every object 8-byte aligned
     
-    // Check if key already exists
-    if (curr != NULL && strcmp(curr->key, key_copy) == 0) {
-        // KEY EXISTS: Append value to existing key's value list
-        free(key_copy);  // Don't need duplicate key
-        
-        Value_node* new_value = (Value_node*)malloc(sizeof(Value_node));
-        new_value->value = value_copy;
-        new_value->next = NULL;
-        
-        // Append to tail for O(1) insertion
-        if (curr->values_tail) {
-            curr->values_tail->next = new_value;
-        } else {
-            curr->values = new_value;
-        }
-        curr->values_tail = new_value;
-        
-    } else {
-        // KEY DOESN'T EXIST: Insert new key entry (maintaining sorted order)
-        Key_entry* new_key = (Key_entry*)malloc(sizeof(Key_entry));
-        new_key->key = key_copy;
-        
-        Value_node* new_value = (Value_node*)malloc(sizeof(Value_node));
-        new_value->value = value_copy;
-        new_value->next = NULL;
-        
-        new_key->values = new_value;
-        new_key->values_tail = new_value;
-        new_key->next = curr;
-        
-        // Insert into sorted list
-        if (prev == NULL) {
-            partitions[p].head = new_key;
+    Arena_chunk* chunk = arena->head;
+    if (chunk == NULL || chunk->capacity - chunk->used < size) {
+        size_t capacity = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+        if (arena->node >= 0) {
+            chunk = arena_chunk_on_node(capacity, arena->node, &capacity);
         } else {
-            prev->next = new_key;
+            chunk = (Arena_chunk*)malloc(sizeof(Arena_chunk) + capacity);
         }
-        
-        partitions[p].key_count++;
+        chunk->next = arena->head;
+        chunk->used = 0;
+        chunk->capacity = capacity;
+        arena->head = chunk;
+        arena->allocated += capacity;
     }
     
-    // Update partition statistics (for SJF in Reduce phase)
-    partitions[p].total_pairs++;
-    
-    pthread_mutex_unlock(&partitions[p].partition_mutex);
-    // END CRITICAL SECTION
+    void* ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
 }
 
 /**
- * MR_GetNext - Get next value for a given key in a partition
- * 
- * @param key: Key to retrieve values for
- * @param partition_idx: Partition index
- * @return: Duplicated value string (CALLER MUST FREE), or NULL if no more values
+ * arena_strndup - Copy a string into an arena
  * 
- * Iterator Pattern:
- * - First call for a key: searches for key, initializes iterator
- * - Subsequent calls: advances iterator through value list
- * - Returns NULL when no more values
+ * @param arena: Arena to allocate from
+ * @param str: Source string
+ * @param len: Length of str (without '\0')
+ * @param min_size: Minimum size of the copy (room to grow in place)
+ * @return: Null-terminated copy owned by the arena
+ */
+static char* arena_strndup(Arena* arena, const char* str, size_t len, size_t min_size) {
+    size_t size = len + 1 > min_size ? len + 1 : min_size;
+    char* copy = (char*)arena_alloc(arena, size);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+/**
+ * arena_release - Free every chunk of an arena at once
  * 
- * Thread Safety:
- * - No locking needed (only one Reduce task per partition at a time)
- * - Iterator state is per-partition (no conflicts)
+ * @param arena: Arena to release (left empty and reusable)
+ */
+static void arena_release(Arena* arena) {
+    Arena_chunk* chunk = arena->head;
+    while (chunk != NULL) {
+        Arena_chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+    arena->allocated = 0;
+}
+
+/**
+ * arena_reset - Empty an arena but keep its newest chunk for reuse
  * 
- * Memory:
- * - Returns duplicated value (CALLER MUST FREE)
- * - Original values freed during partition cleanup
+ * @param arena: Arena to empty
  */
-char* MR_GetNext(char* key, unsigned int partition_idx) {
-    // No lock needed: only one Reduce task per partition at a time
+static void arena_reset(Arena* arena) {
+    Arena_chunk* keep = arena->head;
+    if (keep == NULL) {
+        return;
+    }
+    arena->head = keep->next;
+    arena_release(arena);
     
-    IteratorState* iter = &iterators[partition_idx];
+    keep->next = NULL;
+    keep->used = 0;
+    arena->head = keep;
+    arena->allocated = keep->capacity;
+}
+
+// 33^k mod 2^64 for k = 0..8, for hashing 8 bytes per step
+static const unsigned long djb2_pow[9] = {
+    1ul, 33ul, 1089ul, 35937ul, 1185921ul, 39135393ul, 1291467969ul,
+    42618442977ul, 1406408618241ul
+};
+
+/**
+ * hash_key_n - DJB2 hash of a key, 8 bytes per step
+ * 
+ * @param key: First byte of the key (need not be NUL-terminated)
+ * @param len: Key length
+ * @return: Full (unreduced) hash value
+ * 
+ * DJB2 (hash = hash * 33 + c) unrolled: one step over bytes c0..c7 is
+ * hash * 33^8 + c0 * 33^7 + ... + c7, so the eight multiplies are
+ * independent instead of one long dependency chain. Bit-identical to
+ * the byte loop, including the signed char promotion.
+ */
+static unsigned long hash_key_n(const char* key, size_t len) {
+    unsigned long hash = 5381;
+    size_t i = 0;
     
-    // First call for this key: initialize iterator
-    if (iter->current_key == NULL || 
-        strcmp(iter->current_key->key, key) != 0) {
-        
-        // Search for key in partition
-        Key_entry* entry = partitions[partition_idx].head;
-        while (entry != NULL && strcmp(entry->key, key) != 0) {
-            entry = entry->next;
-        }
-        
-        // Initialize iterator
-        iter->current_key = entry;
-        iter->current_value = (entry != NULL) ? entry->values : NULL;
+    for (; i + 8 <= len; i += 8) {
+        const char* c = key + i;
+        hash = hash * djb2_pow[8]
+             + (unsigned long)c[0] * djb2_pow[7] + (unsigned long)c[1] * djb2_pow[6]
+             + (unsigned long)c[2] * djb2_pow[5] + (unsigned long)c[3] * djb2_pow[4]
+             + (unsigned long)c[4] * djb2_pow[3] + (unsigned long)c[5] * djb2_pow[2]
+             + (unsigned long)c[6] * djb2_pow[1] + (unsigned long)c[7];
     }
-    
-    // Return next value
-    if (iter->current_value == NULL) {
-        return NULL;  // No more values for this key
+    for (; i < len; i++) {
+        hash = ((hash << 5) + hash) + key[i];  // hash * 33 + c
     }
     
-    // Duplicate value for caller (they must free it)
-    char* value = strdup(iter->current_value->value);
-    
-    // Advance iterator
-    iter->current_value = iter->current_value->next;
-    
-    return value;
+    return hash;
+}
+
+// Load up to 8 bytes into a word (native byte order, missing bytes = 0)
+static inline uint64_t load_word(const char* p, size_t n) {
+    uint64_t w = 0;
+    memcpy(&w, p, n);
+    return w;
+}
+
+// 64x64 -> 128 bit multiply, folded to 64 bits (wyhash's mum)
+static inline uint64_t mum(uint64_t a, uint64_t b) {
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
 }
 
 /**
- * MR_Map - Wrapper function for Map tasks
- * 
- * @param threadarg: MapArgs structure containing filename and mapper function
+ * fast_hash_n - wyhash-style hash of a key, 16 bytes per step
  * 
- * Process:
- * 1. Extract arguments
- * 2. Call user's Mapper function
- * 3. Free argument structure
+ * @param key: First byte of the key (need not be NUL-terminated)
+ * @param len: Key length
+ * @return: 64-bit hash, well mixed in every bit
  * 
- * Note: User's Mapper calls MR_Emit to write key-value pairs
+ * Used instead of DJB2 with MR_Options.fast_hash. Keys land in other
+ * partitions than MR_Partitioner would pick.
  */
-void MR_Map(void* threadarg) {
-    MapArgs* args = (MapArgs*)threadarg;
+static unsigned long fast_hash_n(const char* key, size_t len) {
+    const uint64_t k0 = 0xa0761d6478bd642full;
+    const uint64_t k1 = 0xe7037ed1a0b428dbull;
+    const uint64_t k2 = 0x8ebc6af09c88c6e3ull;
+    uint64_t seed = k0 ^ mum(len ^ k1, k2);
+    size_t n = len;
     
-    // Call user's Map function
-    // User's Map function will call MR_Emit to emit key-value pairs
-    args->mapper_func(args->filename);
+    while (n > 16) {
+        seed = mum(load_word(key, 8) ^ k1, load_word(key + 8, 8) ^ seed);
+        key += 16;
+        n -= 16;
+    }
+    uint64_t a = load_word(key, n < 8 ? n : 8);
+    uint64_t b = (n > 8) ? load_word(key + 8, n - 8) : 0;
     
-    // Free argument structure
-    free(args);
+    return mum(k1 ^ len, mum(a ^ k1, b ^ seed));
 }
 
 /**
- * MR_Reduce - Wrapper function for Reduce tasks
+ * key_hash - Hash of a key as cached in Key_entry and staged pairs
  * 
- * @param threadarg: ReduceArgs structure containing partition index and reducer function
+ * DJB2 by default, so that partition = hash % P matches MR_Partitioner;
+ * the faster wyhash-style hash with MR_Options.fast_hash. The value is
+ * computed once per emit and reused for the partition choice, the
+ * staging index and the partition hash index.
+ */
+static inline unsigned long key_hash(const char* key, size_t len) {
+    return ctx->use_fast_hash ? fast_hash_n(key, len) : hash_key_n(key, len);
+}
+
+/**
+ * key_bucket - Storage partition of a key
  * 
- * Process:
- * 1. Extract arguments
- * 2. Iterate through all keys in partition
- * 3. For each key, call user's Reducer function
- * 4. Free argument structure
+ * @param key: Key bytes (need not be NUL-terminated)
+ * @param len: Key length
+ * @param hash: key_hash of key
+ * @return: Index in partitions[], [0, num_buckets)
  * 
- * Note: User's Reducer calls MR_GetNext to iterate through values
+ * With balance > 1 there are num_buckets = P * balance storage
+ * partitions ("buckets") that assign_buckets maps onto P reducers.
+ * A user partitioner is called with P and its result is the partition:
+ * balance is ignored then, so bucket i is partition i.
  */
-void MR_Reduce(void* threadarg) {
-    ReduceArgs* args = (ReduceArgs*)threadarg;
-    unsigned int p = args->partition_idx;
-    Reducer reducer = args->reducer_func;
-    
-    // Iterate through all keys in partition
-    Key_entry* key_entry = partitions[p].head;
-    while (key_entry != NULL) {
-        // Reset iterator for this key
-        iterators[p].current_key = NULL;
-        iterators[p].current_value = NULL;
-        
-        // Call user's Reduce function
-        // User's Reducer will call MR_GetNext to iterate through values
-        reducer(key_entry->key, p);
-        
-        key_entry = key_entry->next;
+static unsigned int key_bucket(const char* key, size_t len, unsigned long hash) {
+    if (ctx->user_partitioner != NULL) {
+        // User functions get a NUL-terminated key
+        char small[128];
+        char* copy = (len < sizeof(small)) ? small : (char*)malloc(len + 1);
+        memcpy(copy, key, len);
+        copy[len] = '\0';
+        unsigned int bucket = ctx->user_partitioner(copy, ctx->num_partitions) % ctx->num_partitions;
+        if (copy != small) {
+            free(copy);
+        }
+        return bucket;
     }
-    
-    // Free argument structure
-    free(args);
+    if (ctx->use_fast_hash) {
+        // Multiply-shift range reduction (no division)
+        return (unsigned int)(((hash >> 32) * ctx->num_buckets) >> 32);
+    }
+    return hash % ctx->num_buckets;
 }
 
 /**
- * Comparator functions for SJF sorting
+ * MR_Partitioner - Hash function to determine partition for a key
+ * 
+ * @param key: Key string
+ * @param num_partitions: Total number of partitions (P)
+ * @return: Partition index [0, P-1]
+ * 
+ * Uses DJB2 hash algorithm:
+ * - Fast single-pass computation (8 bytes per step)
+ * - Good distribution (avoids clustering)
+ * - Deterministic (same key always maps to same partition)
+ * MR_Emit places keys the same way unless MR_Options asks for a custom
+ * partitioner, fast_hash or balance.
  */
-static int compare_file_size(const void* a, const void* b) {
-    FileInfo* fa = (FileInfo*)a;
-    FileInfo* fb = (FileInfo*)b;
-    
-    if (fa->size < fb->size) return -1;
-    if (fa->size > fb->size) return 1;
-    return 0;
+unsigned int MR_Partitioner(char* key, unsigned int num_partitions) {
+    return hash_key_n(key, strlen(key)) % num_partitions;
 }
 
-static int compare_partition_size(const void* a, const void* b) {
-    PartitionInfo* pa = (PartitionInfo*)a;
-    PartitionInfo* pb = (PartitionInfo*)b;
+/**
+ * table_slot - Map a key hash to its home slot in a partition table
+ * 
+ * @param hash: Cached DJB2 hash of the key
+ * @param capacity: Table capacity (power of two)
+ * @return: Slot index [0, capacity-1]
+ * 
+ * Every key in a partition shares the same hash % P, so the low bits are
+ * heavily biased. Fibonacci hashing spreads them across the table.
+ */
+static inline unsigned int table_slot(unsigned long hash, unsigned int capacity) {
+    return (unsigned int)((hash * 11400714819323198485ull) >> 32) & (capacity - 1);
+}
+
+/**
+ * partition_find - Look up a key in a partition's hash index
+ * 
+ * @param part: Partition to search
+ * @param key: Key string
+ * @param hash: key_hash of key
+ * @return: Matching Key_entry, or NULL if the key is not present
+ * 
+ * Synchronization: caller holds partition_mutex (or the Map phase is over)
+ */
+static Key_entry* partition_find(Partition* part, const char* key, unsigned long hash) {
+    if (part->table == NULL) {
+        return NULL;
+    }
     
-    if (pa->size < pb->size) return -1;
-    if (pa->size > pb->size) return 1;
-    return 0;
+    // Linear probing: stop at the first empty slot
+    unsigned int mask = part->table_capacity - 1;
+    unsigned int i = table_slot(hash, part->table_capacity);
+    while (part->table[i] != NULL) {
+        Key_entry* entry = part->table[i];
+        if (entry->hash == hash && strcmp(entry->key, key) == 0) {
+            return entry;
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
 }
 
 /**
- * MR_Run - Main MapReduce orchestrator
+ * partition_grow - Double a partition's hash index and rehash all keys
  * 
- * @param file_count: Number of input files
- * @param file_names: Array of filename strings
- * @param mapper: User's Map function
- * @param reducer: User's Reduce function
- * @param num_workers: Number of threads in thread pool
- * @param num_parts: Number of partitions (P)
+ * @param part: Partition whose table is full enough to resize
  * 
- * Execution Flow:
- * 1. Initialize partitions and thread pool
- * 2. MAP PHASE: Sort files by size, submit Map jobs (SJF)
- * 3. BARRIER: ThreadPool_check() waits for all Map jobs
- * 4. REDUCE PHASE: Sort partitions by size, submit Reduce jobs (SJF)
- * 5. BARRIER: ThreadPool_check() waits for all Reduce jobs
- * 6. Cleanup: Free all data structures
+ * Uses the cached hash in each Key_entry, so no key strings are rehashed.
+ * Synchronization: caller holds partition_mutex
+ */
+static void partition_grow(Partition* part) {
+    unsigned int new_capacity = part->table_capacity ? part->table_capacity * 2
+                                                     : PARTITION_TABLE_INIT;
+    Key_entry** new_table = (Key_entry**)calloc(new_capacity, sizeof(Key_entry*));
+    unsigned int mask = new_capacity - 1;
+    
+    for (Key_entry* entry = part->head; entry != NULL; entry = entry->next) {
+        unsigned int i = table_slot(entry->hash, new_capacity);
+        while (new_table[i] != NULL) {
+            i = (i + 1) & mask;
+        }
+        new_table[i] = entry;
+    }
+    
+    free(part->table);
+    part->table = new_table;
+    part->table_capacity = new_capacity;
+}
+
+/**
+ * partition_insert_key - Add a new key to a partition
  * 
- * Synchronization:
- * - ThreadPool_check() provides barrier between Map and Reduce
- * - Partition mutexes protect concurrent MR_Emit calls
- * - Same thread pool used for both phases (reuse)
+ * @param part: Target partition
+ * @param key: Key string (copied into the partition arena)
+ * @param hash: key_hash of key
+ * @return: Newly created Key_entry (with an empty value list)
  * 
- * Memory Management:
- * - All dynamically allocated memory freed before return
- * - Traverses all partitions → keys → values
- * - Valgrind clean (no leaks)
+ * Keys are pushed onto head in arrival order; sort_partition_keys
+ * restores lexicographic order before the partition is reduced.
+ * Synchronization: caller holds partition_mutex
  */
-void MR_Run(unsigned int file_count, char* file_names[],
-            Mapper mapper, Reducer reducer,
-            unsigned int num_workers, unsigned int num_parts) {
+static Key_entry* partition_insert_key(Partition* part, const char* key, unsigned long hash) {
+    // Keep load factor <= 50% so probe sequences stay short
+    if ((part->key_count + 1) * 2 > part->table_capacity) {
+        partition_grow(part);
+    }
     
-    num_partitions = num_parts;
+    Key_entry* new_key = (Key_entry*)arena_alloc(&part->arena, sizeof(Key_entry));
+    new_key->key = arena_strndup(&part->arena, key, strlen(key), 0);
+    new_key->hash = hash;
+    new_key->values = NULL;
+    new_key->values_tail = NULL;
+    new_key->value_count = 0;
+    new_key->next = part->head;
+    part->head = new_key;
+    part->unsorted_count++;
     
-    // ===== STEP 1: Initialize Partitions =====
-    partitions = (Partition*)calloc(num_parts, sizeof(Partition));
-    iterators = (IteratorState*)calloc(num_parts, sizeof(IteratorState));
+    unsigned int mask = part->table_capacity - 1;
+    unsigned int i = table_slot(hash, part->table_capacity);
+    while (part->table[i] != NULL) {
+        i = (i + 1) & mask;
+    }
+    part->table[i] = new_key;
     
-    for (unsigned int i = 0; i < num_parts; i++) {
-        partitions[i].head = NULL;
-        partitions[i].key_count = 0;
-        partitions[i].total_pairs = 0;
-        pthread_mutex_init(&partitions[i].partition_mutex, NULL);
-        
-        iterators[i].current_key = NULL;
-        iterators[i].current_value = NULL;
+    part->key_count++;
+    return new_key;
+}
+
+/**
+ * compare_key_entries - qsort comparator ordering Key_entry pointers by key
+ */
+static int compare_key_entries(const void* a, const void* b) {
+    const Key_entry* ka = *(const Key_entry* const*)a;
+    const Key_entry* kb = *(const Key_entry* const*)b;
+    return strcmp(ka->key, kb->key);
+}
+
+/**
+ * sort_partition_keys - Relink a partition's key list in sorted order
+ * 
+ * @param part: Partition to sort
+ * 
+ * New keys are pushed in front of head, so the list is an unsorted
+ * prefix of unsorted_count keys followed by the sorted suffix starting
+ * at sorted_keys. Only the prefix is sorted (O(U log U)); it is then
+ * merged into the suffix in one O(K) pass. Called at the start of
+ * MR_Reduce, before every spill and, in pipelined runs, from pre-sort
+ * jobs while the last Map jobs are still running.
+ * Synchronization: caller holds partition_mutex, or the Map phase is over
+ */
+static void sort_partition_keys(Partition* part) {
+    unsigned int n = part->unsorted_count;
+    if (n == 0) {
+        return;
     }
     
-    // ===== STEP 2: Create Thread Pool =====
-    global_threadpool = ThreadPool_create(num_workers);
+    Key_entry** order = (Key_entry**)malloc(n * sizeof(Key_entry*));
+    Key_entry* entry = part->head;
+    for (unsigned int i = 0; i < n; i++) {
+        order[i] = entry;
+        entry = entry->next;
+    }
     
-    // ===== STEP 3: MAP PHASE with SJF =====
+    qsort(order, n, sizeof(Key_entry*), compare_key_entries);
     
-    // 3a. Get file sizes for SJF scheduling
-    FileInfo* files = (FileInfo*)malloc(file_count * sizeof(FileInfo));
-    for (unsigned int i = 0; i < file_count; i++) {
-        files[i].filename = file_names[i];
-        
-        // Get file size using stat()
-        struct stat st;
-        if (stat(file_names[i], &st) == 0) {
-            files[i].size = st.st_size;
+    // Merge with the sorted suffix (keys are distinct, no ties)
+    Key_entry* merged = NULL;
+    Key_entry** tail = &merged;
+    Key_entry* old = part->sorted_keys;
+    unsigned int i = 0;
+    while (i < n && old != NULL) {
+        if (strcmp(order[i]->key, old->key) < 0) {
+            *tail = order[i++];
         } else {
-            files[i].size = 0;  // Error: treat as empty file
+            *tail = old;
+            old = old->next;
         }
+        tail = &(*tail)->next;
     }
-    
-    // 3b. Sort files by size (ascending for SJF)
-    qsort(files, file_count, sizeof(FileInfo), compare_file_size);
-    
-    // 3c. Submit Map jobs to thread pool (in SJF order)
-    for (unsigned int i = 0; i < file_count; i++) {
-        MapArgs* args = (MapArgs*)malloc(sizeof(MapArgs));
-        args->filename = files[i].filename;
-        args->mapper_func = mapper;
-        
-        ThreadPool_add_job(global_threadpool, 
-                          (thread_func_t)MR_Map,
-                          args,
-                          files[i].size);  // SJF: job size = file size
+    while (i < n) {
+        *tail = order[i++];
+        tail = &(*tail)->next;
     }
+    *tail = old;
     
-    free(files);
+    part->head = merged;
+    part->sorted_keys = merged;
+    part->unsorted_count = 0;
     
-    // 3d. BARRIER: Wait for all Map jobs to complete
-    ThreadPool_check(global_threadpool);
+    free(order);
+}
+
+/**
+ * partition_add - Merge one pair into a partition
+ * 
+ * @param part: Target partition
+ * @param key: Key string (copied into the arena if the key is new)
+ * @param hash: key_hash of key
+ * @param value: Value string (copied into the arena, or folded into the
+ *               existing value when a combiner is active)
+ * 
+ * Synchronization: caller holds partition_mutex
+ */
+static void partition_add(Partition* part, const char* key, unsigned long hash,
+                          char* value) {
+    Key_entry* entry = partition_find(part, key, hash);
+    if (entry == NULL) {
+        // KEY DOESN'T EXIST: Add to hash index (sorted later, before Reduce)
+        entry = partition_insert_key(part, key, hash);
+    } else if (ctx->active_combiner != NULL) {
+        // Combining: keep a single running value per key
+        ctx->active_combiner(entry->key, entry->values->value, value);
+        entry->values->length = strlen(entry->values->value);
+        return;
+    }
     
-    // ===== STEP 4: REDUCE PHASE with SJF =====
+    // With a combiner the first value doubles as the running value
+    size_t value_len = strlen(value);
+    Value_node* node = (Value_node*)arena_alloc(&part->arena, sizeof(Value_node));
+    node->value = arena_strndup(&part->arena, value, value_len,
+                                ctx->active_combiner ? MR_COMBINE_VALUE_MAX : 0);
+    node->length = value_len;
+    node->next = NULL;
     
-    // 4a. Get partition sizes for SJF scheduling
-    PartitionInfo* parts = (PartitionInfo*)malloc(num_parts * sizeof(PartitionInfo));
-    for (unsigned int i = 0; i < num_parts; i++) {
-        parts[i].partition_idx = i;
-        parts[i].size = partitions[i].total_pairs;  // SJF: job size = # key-value pairs
+    // Append to tail for O(1) insertion
+    if (entry->values_tail) {
+        entry->values_tail->next = node;
+    } else {
+        entry->values = node;
     }
+    entry->values_tail = node;
+    entry->value_count++;
     
-    // 4b. Sort partitions by size (ascending for SJF)
-    qsort(parts, num_parts, sizeof(PartitionInfo), compare_partition_size);
-    
-    // 4c. Submit Reduce jobs to thread pool (in SJF order)
-    for (unsigned int i = 0; i < num_parts; i++) {
-        ReduceArgs* args = (ReduceArgs*)malloc(sizeof(ReduceArgs));
-        args->partition_idx = parts[i].partition_idx;
-        args->reducer_func = reducer;
+    // Update partition statistics (for SJF in Reduce phase)
+    part->total_pairs++;
+}
+
+/**
+ * spill_open - Create an anonymous run file in spill_dir
+ * 
+ * @return: Read/write stream, or NULL if no file could be created
+ * 
+ * The file is unlinked right away, so it disappears when it is closed
+ * (or the process dies) and never needs cleaning up by name.
+ */
+static FILE* spill_open(void) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/mr-spill-XXXXXX", ctx->spill_dir);
+    
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return NULL;
+    }
+    unlink(path);
+    
+    FILE* fp = fdopen(fd, "w+");
+    if (fp == NULL) {
+        close(fd);
+    }
+    return fp;
+}
+
+/**
+ * partition_spill - Write a partition's pairs to a sorted run file
+ * 
+ * @param part: Partition over its share of the memory budget
+ * 
+ * Run format (native byte order, only read back by this process):
+ *   per key, ascending: key_len (uint), key bytes, value_count (ulong),
+ *   then value_count times: value_len (uint), value bytes
+ * Afterwards the partition is emptied (arena released, index cleared)
+ * and keeps filling from scratch; total_pairs keeps counting for SJF.
+ * If the run cannot be written the pairs simply stay in memory and the
+ * partition stops trying (the error is reported once).
+ * 
+ * Synchronization: caller holds partition_mutex
+ */
+static void partition_spill(Partition* part) {
+    FILE* run = spill_open();
+    if (run == NULL) {
+        perror("MapReduce: spill");
+        part->spill_failed = 1;
+        return;
+    }
+    
+    sort_partition_keys(part);
+    for (Key_entry* entry = part->head; entry != NULL; entry = entry->next) {
+        unsigned int key_len = strlen(entry->key);
+        fwrite(&key_len, sizeof(key_len), 1, run);
+        fwrite(entry->key, 1, key_len, run);
+        fwrite(&entry->value_count, sizeof(entry->value_count), 1, run);
+        for (Value_node* node = entry->values; node != NULL; node = node->next) {
+            unsigned int value_len = node->length;
+            fwrite(&value_len, sizeof(value_len), 1, run);
+            fwrite(node->value, 1, value_len, run);
+        }
+    }
+    if (fflush(run) != 0 || ferror(run)) {
+        perror("MapReduce: spill");
+        part->spill_failed = 1;
+        fclose(run);
+        return;
+    }
+    
+    part->runs = (FILE**)realloc(part->runs, (part->run_count + 1) * sizeof(FILE*));
+    part->runs[part->run_count++] = run;
+    
+    arena_release(&part->arena);
+    if (part->table != NULL) {
+        memset(part->table, 0, part->table_capacity * sizeof(Key_entry*));
+    }
+    part->head = NULL;
+    part->sorted_keys = NULL;
+    part->unsorted_count = 0;
+    part->key_count = 0;
+}
+
+/**
+ * now_ns - Monotonic clock in nanoseconds (run statistics)
+ */
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+/**
+ * partition_lock - Take partition_mutex on the emit path
+ * 
+ * With statistics on, an uncontended trylock costs nothing extra; only a
+ * blocked acquisition is timed. The counters are updated while holding
+ * the mutex they describe, so they need no further synchronization.
+ */
+static void partition_lock(Partition* part) {
+    if (ctx->stats_path == NULL) {
+        pthread_mutex_lock(&part->partition_mutex);
+        return;
+    }
+    if (pthread_mutex_trylock(&part->partition_mutex) == 0) {
+        return;
+    }
+    
+    unsigned long long start = now_ns();
+    pthread_mutex_lock(&part->partition_mutex);
+    part->lock_wait_ns += now_ns() - start;
+    part->lock_contended++;
+}
+
+/**
+ * partition_check_budget - Spill a partition once its arena is too big
+ * 
+ * Synchronization: caller holds partition_mutex
+ */
+static inline void partition_check_budget(Partition* part) {
+    if (ctx->spill_limit != 0 && part->arena.allocated > ctx->spill_limit && !part->spill_failed) {
+        partition_spill(part);
+    }
+}
+
+/**
+ * flush_emit_buffer - Move all staged pairs of one partition into it
+ * 
+ * @param p: Partition index
+ * @param buf: Calling thread's staging buffer for partition p
+ * 
+ * Synchronization:
+ * - One partition_mutex acquisition per batch instead of per pair
+ */
+static void flush_emit_buffer(unsigned int p, Emit_buffer* buf) {
+    if (buf->count == 0) {
+        return;
+    }
+    
+    // CRITICAL SECTION: Modify partition
+    partition_lock(&ctx->partitions[p]);
+    for (unsigned int i = 0; i < buf->count; i++) {
+        partition_add(&ctx->partitions[p], buf->pairs[i].key,
+                      buf->pairs[i].hash, buf->pairs[i].value);
+    }
+    partition_check_budget(&ctx->partitions[p]);
+    pthread_mutex_unlock(&ctx->partitions[p].partition_mutex);
+    // END CRITICAL SECTION
+    
+    // Scratch space is reusable now that the partition holds its own copies
+    buf->count = 0;
+    buf->bytes_used = 0;
+    if (ctx->active_combiner != NULL) {
+        memset(buf->index, 0, sizeof(buf->index));
+    }
+}
+
+/**
+ * find_staged - Look up a key among a buffer's staged pairs
+ * 
+ * @param buf: Calling thread's staging buffer
+ * @param key: Key bytes (need not be NUL-terminated)
+ * @param key_len: Length of key
+ * @param hash: key_hash of key
+ * @return: Staged pair for key, or NULL if it is not staged
+ * 
+ * Only used with a combiner (the index is not maintained otherwise).
+ */
+static Staged_pair* find_staged(Emit_buffer* buf, const char* key, size_t key_len,
+                                unsigned long hash) {
+    unsigned int i = table_slot(hash, EMIT_BUFFER_SLOTS);
+    while (buf->index[i] != 0) {
+        Staged_pair* pair = &buf->pairs[buf->index[i] - 1];
+        if (pair->hash == hash && memcmp(pair->key, key, key_len) == 0 &&
+            pair->key[key_len] == '\0') {
+            return pair;
+        }
+        i = (i + 1) & (EMIT_BUFFER_SLOTS - 1);
+    }
+    return NULL;
+}
+
+/**
+ * stage_pair - Copy a pair into a staging buffer
+ * 
+ * @param buf: Calling thread's staging buffer
+ * @param key: Key bytes (need not be NUL-terminated)
+ * @param key_len: Length of key
+ * @param hash: key_hash of key
+ * @param value: Value string
+ * @param value_len: Length of value
+ * @param value_size: Scratch bytes to reserve for value (>= value_len + 1)
+ * 
+ * PRECONDITION: buf has a free pair and enough scratch space
+ */
+static void stage_pair(Emit_buffer* buf, const char* key, size_t key_len,
+                       unsigned long hash, const char* value, size_t value_len,
+                       size_t value_size) {
+    Staged_pair* pair = &buf->pairs[buf->count];
+    
+    pair->key = buf->strings + buf->bytes_used;
+    memcpy(pair->key, key, key_len);
+    pair->key[key_len] = '\0';
+    buf->bytes_used += key_len + 1;
+    
+    pair->value = buf->strings + buf->bytes_used;
+    memcpy(pair->value, value, value_len + 1);
+    buf->bytes_used += value_size;
+    
+    pair->hash = hash;
+    
+    if (ctx->active_combiner != NULL) {
+        unsigned int i = table_slot(hash, EMIT_BUFFER_SLOTS);
+        while (buf->index[i] != 0) {
+            i = (i + 1) & (EMIT_BUFFER_SLOTS - 1);
+        }
+        buf->index[i] = (unsigned short)(buf->count + 1);
+    }
+    
+    buf->count++;
+}
+
+/**
+ * emit_staged - Stage a pair in the calling thread's buffer
+ * 
+ * @param p: Bucket of key (key_bucket)
+ * @param key: Key bytes (need not be NUL-terminated)
+ * @param key_len: Length of key
+ * @param hash: key_hash of key
+ * @param value: Value string
+ * @return: 1 if the pair was staged or folded, 0 if the caller has to
+ *          insert it directly (outside MR_Map, or too large to stage)
+ */
+static int emit_staged(unsigned int p, const char* key, size_t key_len,
+                       unsigned long hash, char* value) {
+    if (emit_buffers == NULL) {
+        return 0;
+    }
+    
+    Emit_buffer* buf = &emit_buffers[p];
+    
+    if (ctx->active_combiner != NULL) {
+        Staged_pair* pair = find_staged(buf, key, key_len, hash);
+        if (pair != NULL) {
+            // Folded into a pair this thread already staged
+            ctx->active_combiner(pair->key, pair->value, value);
+            return 1;
+        }
+    }
+    
+    size_t value_len = strlen(value);
+    
+    // With a combiner, reserve room for the running value to grow in place
+    size_t value_size = value_len + 1;
+    if (ctx->active_combiner != NULL && value_size < MR_COMBINE_VALUE_MAX) {
+        value_size = MR_COMBINE_VALUE_MAX;
+    }
+    size_t needed = key_len + 1 + value_size;
+    
+    if (needed > EMIT_BUFFER_BYTES) {
+        // Pair too large for scratch space
+        return 0;
+    }
+    if (buf->count == EMIT_BUFFER_PAIRS ||
+        EMIT_BUFFER_BYTES - buf->bytes_used < needed) {
+        flush_emit_buffer(p, buf);
+    }
+    // Stage the pair; MR_Map flushes whatever is left when it ends
+    stage_pair(buf, key, key_len, hash, value, value_len, value_size);
+    return 1;
+}
+
+/**
+ * emit_direct - Merge one pair straight into its partition
+ * 
+ * @param p: Bucket of key (key_bucket)
+ * @param key: Key string (NUL-terminated)
+ * @param hash: key_hash of key
+ * @param value: Value string
+ */
+static void emit_direct(unsigned int p, const char* key, unsigned long hash, char* value) {
+    // CRITICAL SECTION: Modify partition
+    partition_lock(&ctx->partitions[p]);
+    partition_add(&ctx->partitions[p], key, hash, value);
+    partition_check_budget(&ctx->partitions[p]);
+    pthread_mutex_unlock(&ctx->partitions[p].partition_mutex);
+    // END CRITICAL SECTION
+}
+
+/**
+ * MR_Emit - Emit a key-value pair to intermediate storage
+ * 
+ * @param key: Key string (will be copied)
+ * @param value: Value string (will be copied)
+ * 
+ * Process:
+ * 1. Hash key once (key_hash) to pick the partition and its hash slot
+ * 2. Inside MR_Map: copy the pair into the thread's staging buffer for
+ *    that partition (or fold into a staged pair when a combiner is set),
+ *    flushing the buffer when it runs out of pairs or scratch space
+ * 3. Otherwise (or for oversized pairs): lock the partition and merge
+ *    the pair directly
+ * 
+ * Synchronization:
+ * - Staging buffers are thread-local (no locking on the common path)
+ * - Flushes take the partition mutex once per batch of pairs
+ * - O(1) amortized work per pair inside the critical section
+ * 
+ * Memory:
+ * - Copies both key and value (caller may reuse buffers)
+ * - Partition copies live in the partition arena, released in MR_Run
+ */
+void MR_Emit(char* key, char* value) {
+    // Determine target partition (same result as MR_Partitioner)
+    size_t key_len = strlen(key);
+    unsigned long hash = key_hash(key, key_len);
+    unsigned int p = key_bucket(key, key_len, hash);
+    
+    if (!emit_staged(p, key, key_len, hash, value)) {
+        emit_direct(p, key, hash, value);
+    }
+}
+
+/**
+ * MR_EmitN - MR_Emit for a key given as pointer and length
+ * 
+ * @param key: First byte of the key, e.g. inside a mapped input file
+ * @param key_len: Length of key
+ * @param value: Value string (will be copied)
+ * 
+ * The key is copied straight into the staging buffer, so tokens never
+ * need their own NUL-terminated copy; only the rare direct insert
+ * makes a temporary one.
+ */
+void MR_EmitN(const char* key, size_t key_len, char* value) {
+    unsigned long hash = key_hash(key, key_len);
+    unsigned int p = key_bucket(key, key_len, hash);
+    
+    if (!emit_staged(p, key, key_len, hash, value)) {
+        char* copy = strndup(key, key_len);
+        emit_direct(p, copy, hash, value);
+        free(copy);
+    }
+}
+
+/**
+ * lookup_key - Find a key among the buckets of a reducer
+ * 
+ * @param key: Key string
+ * @param partition_idx: Partition (reducer) index
+ * @return: Key_entry of key, or NULL if partition_idx does not hold it
+ */
+static Key_entry* lookup_key(char* key, unsigned int partition_idx) {
+    size_t len = strlen(key);
+    unsigned long hash = key_hash(key, len);
+    unsigned int bucket = key_bucket(key, len, hash);
+    
+    if (ctx->bucket_owner[bucket] != partition_idx) {
+        return NULL;
+    }
+    return partition_find(&ctx->partitions[bucket], key, hash);
+}
+
+/**
+ * next_value - Advance the partition iterator for a key
+ * 
+ * @param key: Key to retrieve values for
+ * @param partition_idx: Partition index
+ * @return: Next value node of key, or NULL if no more values
+ * 
+ * Iterator Pattern:
+ * - MR_Reduce positions the cursor on the key before calling the reducer,
+ *   so the common case starts iterating in O(1)
+ * - Different key or partition: looks the key up in the hash index and
+ *   restarts the cursor there
+ * - Returns NULL when no more values
+ * 
+ * Thread Safety:
+ * - No locking needed (partition is read-only once the Map phase is over)
+ * - Iterator state is per-thread (no conflicts between reducers)
+ */
+static Value_node* next_value(char* key, unsigned int partition_idx) {
+    IteratorState* iter = &reduce_iter;
+    
+    // Cursor not on this key: initialize iterator
+    if (iter->current_key == NULL ||
+        iter->partition_idx != partition_idx ||
+        (iter->current_key->key != key && strcmp(iter->current_key->key, key) != 0)) {
+        
+        // Look key up through the partition hash index
+        Key_entry* entry = lookup_key(key, partition_idx);
+        
+        // Initialize iterator
+        iter->partition_idx = partition_idx;
+        iter->current_key = entry;
+        iter->current_value = (entry != NULL) ? entry->values : NULL;
+    }
+    
+    // Return next value
+    Value_node* node = iter->current_value;
+    if (node != NULL) {
+        iter->current_value = node->next;  // Advance iterator
+    }
+    return node;
+}
+
+/**
+ * MR_GetNext - Get next value for a given key in a partition
+ * 
+ * @param key: Key to retrieve values for
+ * @param partition_idx: Partition index
+ * @return: Duplicated value string (CALLER MUST FREE), or NULL if no more values
+ * 
+ * Memory:
+ * - Returns duplicated value (CALLER MUST FREE)
+ * - Original values released with the partition arena
+ */
+char* MR_GetNext(char* key, unsigned int partition_idx) {
+    Value_node* node = next_value(key, partition_idx);
+    
+    // Duplicate value for caller (they must free it)
+    return (node != NULL) ? strdup(node->value) : NULL;
+}
+
+/**
+ * MR_GetNextView - Zero-copy variant of MR_GetNext
+ * 
+ * @param key: Key to retrieve values for
+ * @param partition_idx: Partition index
+ * @param length: Set to the length of the returned value (may be NULL)
+ * @return: Borrowed, null-terminated value, or NULL if no more values
+ * 
+ * Memory:
+ * - Points into partition storage (DO NOT FREE OR MODIFY)
+ * - Valid for the rest of the current Reduce call
+ */
+const char* MR_GetNextView(char* key, unsigned int partition_idx, size_t* length) {
+    Value_node* node = next_value(key, partition_idx);
+    if (node == NULL) {
+        return NULL;
+    }
+    
+    if (length != NULL) {
+        *length = node->length;
+    }
+    return node->value;
+}
+
+/**
+ * MR_GetCount - Number of values stored for a key
+ * 
+ * @param key: Key being reduced
+ * @param partition_idx: Partition index
+ * @return: Number of values MR_GetNext would return for key (0 if absent)
+ * 
+ * Uses the reducer's cursor or the partition hash index, so it is O(1)
+ * and does not move the iterator. With a combiner each key holds a
+ * single combined value.
+ */
+unsigned long MR_GetCount(char* key, unsigned int partition_idx) {
+    // The key being reduced (which may only exist merged, see reduce_merged)
+    Key_entry* entry = reduce_iter.current_key;
+    if (entry != NULL && reduce_iter.partition_idx == partition_idx &&
+        (entry->key == key || strcmp(entry->key, key) == 0)) {
+        return entry->value_count;
+    }
+    
+    entry = lookup_key(key, partition_idx);
+    return (entry != NULL) ? entry->value_count : 0;
+}
+
+/**
+ * write_all - writev until every byte of iov has been written
+ * 
+ * @param fd: Destination file
+ * @param iov: Pieces to write (modified to track partial writes)
+ * @param count: Entries in iov
+ * @return: 0 on success, -1 on a write error
+ */
+static int write_all(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        // Skip the pieces that are fully written, trim the next one
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+/**
+ * output_flush - Write a sink's buffered bytes, plus optional extra pieces
+ * 
+ * @param sink: Partition output sink (fd already open)
+ * @param extra: Pieces written right after the buffer in the same writev
+ * @param extra_count: Entries in extra (at most 4)
+ */
+static void output_flush(Output_sink* sink, const struct iovec* extra, int extra_count) {
+    struct iovec iov[5];
+    int count = 0;
+    
+    if (sink->used > 0) {
+        iov[count].iov_base = sink->buffer;
+        iov[count].iov_len = sink->used;
+        count++;
+    }
+    for (int i = 0; i < extra_count; i++) {
+        iov[count++] = extra[i];
+    }
+    
+    if (count > 0 && write_all(sink->fd, iov, count) < 0) {
+        perror("MR_Output: write");
+    }
+    sink->used = 0;
+}
+
+/**
+ * output_close - Flush and close a sink (no-op if it was never opened)
+ */
+static void output_close(Output_sink* sink) {
+    if (sink->fd >= 0) {
+        output_flush(sink, NULL, 0);
+        close(sink->fd);
+    }
+    free(sink->buffer);
+    sink->fd = -1;
+    sink->buffer = NULL;
+    sink->used = 0;
+}
+
+/**
+ * MR_Output - Append "<key>: <value>\n" to a partition's result file
+ * 
+ * @param partition_idx: Partition being reduced by the calling thread
+ * @param key: Key of the result
+ * @param value: Result value
+ * 
+ * The file (output_pattern, "result-%d.txt" by default) is opened once
+ * in append mode on first use; records collect in a 64 KB buffer that is
+ * written when full and when MR_Reduce finishes the partition.
+ * Records of OUTPUT_DIRECT_BYTES or more are not copied: they go out in
+ * one writev together with whatever is buffered.
+ * A call from outside a run, or with a partition the run does not have,
+ * is dropped (reported once).
+ * 
+ * Synchronization: none needed, only the partition's reducer writes
+ */
+void MR_Output(unsigned int partition_idx, const char* key, const char* value) {
+    static atomic_flag misuse_reported = ATOMIC_FLAG_INIT;
+    if (ctx == NULL || ctx->outputs == NULL || partition_idx >= ctx->num_partitions) {
+        if (!atomic_flag_test_and_set(&misuse_reported)) {
+            fprintf(stderr, "MR_Output: partition %u is not being reduced, output dropped\n",
+                    partition_idx);
+        }
+        return;
+    }
+    Output_sink* sink = &ctx->outputs[partition_idx];
+    
+    if (sink->fd == -1) {
+        char name[PATH_MAX];
+        snprintf(name, sizeof(name), ctx->output_pattern, partition_idx);
+        sink->fd = open(name, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (sink->fd < 0) {
+            perror(name);
+            sink->fd = -2;  // Report once, drop this partition's output
+            return;
+        }
+        sink->buffer = (char*)malloc(OUTPUT_BUFFER_BYTES);
+        if (sink->buffer == NULL) {
+            perror("MR_Output: malloc");  // Report once, write unbuffered
+        }
+    }
+    if (sink->fd < 0) {
+        return;
+    }
+    
+    struct iovec record[4] = {
+        { (void*)key, strlen(key) },
+        { ": ", 2 },
+        { (void*)value, strlen(value) },
+        { "\n", 1 },
+    };
+    size_t length = record[0].iov_len + 2 + record[2].iov_len + 1;
+    
+    if (length >= OUTPUT_DIRECT_BYTES || sink->buffer == NULL) {
+        output_flush(sink, record, 4);
+        return;
+    }
+    if (OUTPUT_BUFFER_BYTES - sink->used < length) {
+        output_flush(sink, NULL, 0);
+    }
+    for (int i = 0; i < 4; i++) {
+        memcpy(sink->buffer + sink->used, record[i].iov_base, record[i].iov_len);
+        sink->used += record[i].iov_len;
+    }
+}
+
+/**
+ * Comparator functions for SJF sorting
+ */
+static int compare_file_size(const void* a, const void* b) {
+    FileInfo* fa = (FileInfo*)a;
+    FileInfo* fb = (FileInfo*)b;
+    
+    if (fa->size < fb->size) return -1;
+    if (fa->size > fb->size) return 1;
+    return 0;
+}
+
+static int compare_partition_size(const void* a, const void* b) {
+    PartitionInfo* pa = (PartitionInfo*)a;
+    PartitionInfo* pb = (PartitionInfo*)b;
+    
+    if (pa->size < pb->size) return -1;
+    if (pa->size > pb->size) return 1;
+    // Equal sizes: keep index order so bucket assignment is reproducible
+    return (pa->partition_idx > pb->partition_idx) - (pa->partition_idx < pb->partition_idx);
+}
+
+/**
+ * assign_buckets - Map storage buckets onto the P reducers
+ * 
+ * @param loads: Set to the pairs each reducer ends up with (P entries)
+ * 
+ * With balance > 1 the exact pair count of every bucket is known once the
+ * Map phase is over, so buckets are handed out largest first, each to
+ * the reducer with the fewest pairs so far (LPT). A few very frequent
+ * keys then no longer pin a single reducer with most of the data.
+ * Without balancing bucket i simply is partition i.
+ */
+static void assign_buckets(unsigned long* loads) {
+    memset(loads, 0, ctx->num_partitions * sizeof(unsigned long));
+    
+    if (ctx->num_buckets == ctx->num_partitions) {
+        for (unsigned int i = 0; i < ctx->num_buckets; i++) {
+            ctx->bucket_owner[i] = i;
+            loads[i] = ctx->partitions[i].total_pairs;
+        }
+        return;
+    }
+    
+    PartitionInfo* order = (PartitionInfo*)malloc(ctx->num_buckets * sizeof(PartitionInfo));
+    for (unsigned int i = 0; i < ctx->num_buckets; i++) {
+        order[i].partition_idx = i;
+        order[i].size = ctx->partitions[i].total_pairs;
+    }
+    qsort(order, ctx->num_buckets, sizeof(PartitionInfo), compare_partition_size);
+    
+    for (unsigned int i = ctx->num_buckets; i-- > 0; ) {
+        unsigned int least = 0;
+        for (unsigned int r = 1; r < ctx->num_partitions; r++) {
+            if (loads[r] < loads[least]) {
+                least = r;
+            }
+        }
+        ctx->bucket_owner[order[i].partition_idx] = least;
+        loads[least] += order[i].size;
+    }
+    
+    free(order);
+}
+
+/**
+ * home_worker - Worker a partition's jobs are queued on
+ * 
+ * @return: Worker id, or -1 (any worker) when workers are not pinned
+ */
+static int home_worker(unsigned int partition_idx) {
+    return ctx->pin_workers ? (int)(partition_idx % ctx->num_workers) : -1;
+}
+
+/**
+ * submit_reduce_jobs - Queue one Reduce job per partition (SJF order)
+ * 
+ * @param reducer: User's Reduce function
+ * 
+ * Job size is the partition's pair count. Called by MR_RunCtx after the
+ * Map barrier, or in pipelined runs by the Map job that finishes last.
+ */
+static void submit_reduce_jobs(Reducer reducer) {
+    // Get partition sizes for SJF scheduling
+    unsigned long* loads = (unsigned long*)malloc(ctx->num_partitions * sizeof(unsigned long));
+    assign_buckets(loads);
+    
+    PartitionInfo* parts = (PartitionInfo*)malloc(ctx->num_partitions * sizeof(PartitionInfo));
+    for (unsigned int i = 0; i < ctx->num_partitions; i++) {
+        parts[i].partition_idx = i;
+        parts[i].size = loads[i];  // SJF: job size = # key-value pairs
+    }
+    free(loads);
+    
+    // Sort partitions by size (ascending for SJF)
+    qsort(parts, ctx->num_partitions, sizeof(PartitionInfo), compare_partition_size);
+    
+    // Submit Reduce jobs to thread pool (in SJF order)
+    for (unsigned int i = 0; i < ctx->num_partitions; i++) {
+        ReduceArgs* args = (ReduceArgs*)malloc(sizeof(ReduceArgs));
+        args->ctx = ctx;
+        args->partition_idx = parts[i].partition_idx;
+        args->reducer_func = reducer;
+        
+        ThreadPool_add_job_on(ctx->threadpool,
+                             (thread_func_t)MR_Reduce,
+                             args,
+                             parts[i].size,  // SJF: job size = partition size
+                             home_worker(args->partition_idx));
+    }
+    
+    free(parts);
+}
+
+/**
+ * presort_partition - Background job sorting a partition's keys so far
+ * 
+ * @param threadarg: ReduceArgs naming the bucket (reducer unused)
+ * 
+ * Runs on workers left idle by the last Map jobs; MR_Reduce then only
+ * has to sort the keys that arrived afterwards and merge them in.
+ * Skipped if the partition is already being reduced.
+ */
+static void presort_partition(void* threadarg) {
+    ReduceArgs* args = (ReduceArgs*)threadarg;
+    ctx = args->ctx;
+    Partition* part = &ctx->partitions[args->partition_idx];
+    
+    pthread_mutex_lock(&part->partition_mutex);
+    if (!part->reducing) {
+        sort_partition_keys(part);
+    }
+    pthread_mutex_unlock(&part->partition_mutex);
+    
+    free(args);
+}
+
+/**
+ * map_job_done - Account for one finished Map job
+ * 
+ * Called in pipelined runs and when statistics are on (to time the end
+ * of the Map phase).
+ * 
+ * Every partition is final once the last Map job has flushed, so that
+ * job queues the Reduce jobs directly (no Map barrier). The first Map
+ * job whose completion leaves a worker without Map work queues a
+ * pre-sort for every partition instead (size 0: SJF runs them first).
+ */
+static void map_job_done(void) {
+    unsigned int remaining = atomic_fetch_sub(&ctx->maps_pending, 1) - 1;
+    
+    if (remaining == 0 && ctx->stats_path != NULL) {
+        ctx->map_end_ns = now_ns();  // Read by MR_RunCtx after the Reduce barrier
+    }
+    if (!ctx->pipeline_enabled) {
+        return;  // Only counting for the statistics
+    }
+    
+    if (remaining == 0) {
+        submit_reduce_jobs(ctx->active_reducer);
+    } else if (remaining == ctx->presort_trigger) {
+        for (unsigned int i = 0; i < ctx->num_buckets; i++) {
+            ReduceArgs* args = (ReduceArgs*)malloc(sizeof(ReduceArgs));
+            args->ctx = ctx;
+            args->partition_idx = i;
+            args->reducer_func = NULL;
+            ThreadPool_add_job_on(ctx->threadpool, presort_partition, args, 0,
+                                  home_worker(ctx->bucket_owner[i]));
+        }
+    }
+}
+
+/**
+ * MR_Map - Wrapper function for Map tasks
+ * 
+ * @param threadarg: MapArgs structure containing filename and mapper function
+ * 
+ * Process:
+ * 1. Extract arguments
+ * 2. Give this thread one staging buffer per partition
+ * 3. Call user's Mapper function
+ * 4. Flush remaining staged pairs and release the buffers
+ * 5. Free argument structure
+ * 
+ * Note: User's Mapper calls MR_Emit to write key-value pairs
+ */
+void MR_Map(void* threadarg) {
+    MapArgs* args = (MapArgs*)threadarg;
+    ctx = args->ctx;
+    
+    emit_buffers = (Emit_buffer*)calloc(ctx->num_buckets, sizeof(Emit_buffer));
+    
+    // Call user's Map function
+    // User's Map function will call MR_Emit to emit key-value pairs
+    current_map = args;
+    args->mapper_func(args->filename);
+    current_map = NULL;
+    
+    // Job is over: publish everything still staged
+    for (unsigned int p = 0; p < ctx->num_buckets; p++) {
+        flush_emit_buffer(p, &emit_buffers[p]);
+    }
+    free(emit_buffers);
+    emit_buffers = NULL;
+    
+    // Free argument structure
+    free(args);
+    
+    if (ctx->pipeline_enabled || ctx->stats_path != NULL) {
+        map_job_done();
+    }
+}
+
+/**
+ * Run_cursor - Read position in one sorted source of a spilled partition
+ * 
+ * Sources are the partition's run files plus its in-memory keys (the
+ * pairs emitted after the last spill), which always come last.
+ */
+typedef struct {
+    FILE* fp;                       // Run file, NULL for the in-memory keys
+    Key_entry* entry;               // In-memory source: current key
+    char* key;                      // Current key, NULL once exhausted
+    size_t key_capacity;            // Bytes allocated for key (run files)
+    unsigned long value_count;      // Values stored for the current key
+    char* value;                    // Read buffer for values (run files)
+    size_t value_capacity;
+} Run_cursor;
+
+/**
+ * read_string - Read a length-prefixed string from a run file
+ * 
+ * @param fp: Run file
+ * @param buf: Buffer, grown as needed (NUL-terminated on success)
+ * @param capacity: Bytes allocated for *buf
+ * @param length: Set to the string length
+ * @return: 1 on success, 0 at EOF or on a short read
+ */
+static int read_string(FILE* fp, char** buf, size_t* capacity, unsigned int* length) {
+    if (fread(length, sizeof(*length), 1, fp) != 1) {
+        return 0;
+    }
+    if (*capacity < (size_t)*length + 1) {
+        *capacity = (size_t)*length + 1;
+        *buf = (char*)realloc(*buf, *capacity);
+    }
+    if (fread(*buf, 1, *length, fp) != *length) {
+        return 0;
+    }
+    (*buf)[*length] = '\0';
+    return 1;
+}
+
+/**
+ * run_cursor_next - Move a cursor to its next key
+ * 
+ * @return: 1 if the cursor is on a key, 0 once the source is exhausted
+ * 
+ * PRECONDITION: all values of the previous key were consumed
+ */
+static int run_cursor_next(Run_cursor* c) {
+    if (c->fp == NULL) {
+        c->entry = (c->entry != NULL) ? c->entry->next : NULL;
+        c->key = (c->entry != NULL) ? c->entry->key : NULL;
+        c->value_count = (c->entry != NULL) ? c->entry->value_count : 0;
+        return c->key != NULL;
+    }
+    
+    unsigned int key_len;
+    if (!read_string(c->fp, &c->key, &c->key_capacity, &key_len) ||
+        fread(&c->value_count, sizeof(c->value_count), 1, c->fp) != 1) {
+        free(c->key);
+        c->key = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * run_cursor_take - Append (or fold) the current key's values of one source
+ * 
+ * @param c: Cursor positioned on the key
+ * @param merged: Merged entry for the key, built in scratch
+ * @param scratch: Per-key arena for copied values
+ * 
+ * Sources are taken in run order, so values keep their emit order across
+ * spills. In-memory values are linked, not copied; they are always last.
+ */
+static void run_cursor_take(Run_cursor* c, Key_entry* merged, Arena* scratch) {
+    Value_node* mem = (c->fp == NULL) ? c->entry->values : NULL;
+    
+    for (unsigned long i = 0; i < c->value_count; i++) {
+        const char* value;
+        size_t length;
+        if (c->fp != NULL) {
+            unsigned int value_len;
+            if (!read_string(c->fp, &c->value, &c->value_capacity, &value_len)) {
+                break;  // Truncated run: keep what was read
+            }
+            value = c->value;
+            length = value_len;
+        } else if (ctx->active_combiner == NULL) {
+            // Link the in-memory list behind what the runs contributed
+            if (merged->values_tail != NULL) {
+                merged->values_tail->next = mem;
+            } else {
+                merged->values = mem;
+            }
+            merged->values_tail = c->entry->values_tail;
+            merged->value_count += c->value_count;
+            return;
+        } else {
+            value = mem->value;
+            length = mem->length;
+            mem = mem->next;
+        }
+        
+        if (ctx->active_combiner != NULL && merged->values != NULL) {
+            // One running value per key, as without spilling
+            ctx->active_combiner(merged->key, merged->values->value, (char*)value);
+            merged->values->length = strlen(merged->values->value);
+            continue;
+        }
+        
+        Value_node* node = (Value_node*)arena_alloc(scratch, sizeof(Value_node));
+        node->value = arena_strndup(scratch, value, length,
+                                    ctx->active_combiner ? MR_COMBINE_VALUE_MAX : 0);
+        node->length = length;
+        node->next = NULL;
+        if (merged->values_tail != NULL) {
+            merged->values_tail->next = node;
+        } else {
+            merged->values = node;
+        }
+        merged->values_tail = node;
+        merged->value_count++;
+    }
+}
+
+/**
+ * Min-heap of cursor indices ordered by (key, source index)
+ */
+static int cursor_less(const Run_cursor* cursors, unsigned int a, unsigned int b) {
+    int cmp = strcmp(cursors[a].key, cursors[b].key);
+    return cmp < 0 || (cmp == 0 && a < b);
+}
+
+static void heap_push(unsigned int* heap, unsigned int* n, const Run_cursor* cursors,
+                      unsigned int idx) {
+    unsigned int i = (*n)++;
+    while (i > 0 && cursor_less(cursors, idx, heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = idx;
+}
+
+static unsigned int heap_pop(unsigned int* heap, unsigned int* n, const Run_cursor* cursors) {
+    unsigned int top = heap[0];
+    unsigned int last = heap[--(*n)];
+    unsigned int i = 0;
+    
+    while (2 * i + 1 < *n) {
+        unsigned int child = 2 * i + 1;
+        if (child + 1 < *n && cursor_less(cursors, heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!cursor_less(cursors, heap[child], last)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (*n > 0) {
+        heap[i] = last;
+    }
+    return top;
+}
+
+/**
+ * reduce_merged - Reduce a group of buckets in one ascending key order
+ * 
+ * @param group: Buckets owned by reducer p (sorted already)
+ * @param group_count: Entries in group
+ * @param p: Partition (reducer) index
+ * @param reducer: User's Reduce function
+ * 
+ * Streaming k-way merge over every bucket's run files and in-memory
+ * keys. A key lives in one bucket only, so a key found in memory and in
+ * no run is reduced in place; otherwise its values are gathered from
+ * every source into a scratch Key_entry, the cursor is positioned on it
+ * and the reducer runs. Only one spilled key's values are in memory at
+ * a time; with a combiner they are folded into a single value while
+ * reading. In a spilled partition MR_GetNext only sees the key being reduced.
+ */
+static void reduce_merged(const unsigned int* group, unsigned int group_count,
+                          unsigned int p, Reducer reducer) {
+    // Sources per bucket: its runs, then its in-memory keys
+    unsigned int k = 0;
+    for (unsigned int g = 0; g < group_count; g++) {
+        k += ctx->partitions[group[g]].run_count + 1;
+    }
+    Run_cursor* cursors = (Run_cursor*)calloc(k, sizeof(Run_cursor));
+    unsigned int* heap = (unsigned int*)malloc(k * sizeof(unsigned int));
+    unsigned int n = 0;
+    
+    unsigned int c = 0;
+    for (unsigned int g = 0; g < group_count; g++) {
+        Partition* part = &ctx->partitions[group[g]];
+        for (unsigned int i = 0; i < part->run_count; i++, c++) {
+            cursors[c].fp = part->runs[i];
+            rewind(cursors[c].fp);
+            if (run_cursor_next(&cursors[c])) {
+                heap_push(heap, &n, cursors, c);
+            }
+        }
+        // In-memory source: start on the first sorted key
+        Run_cursor* mem = &cursors[c];
+        mem->entry = part->head;
+        mem->key = (part->head != NULL) ? part->head->key : NULL;
+        mem->value_count = (part->head != NULL) ? part->head->value_count : 0;
+        if (mem->key != NULL) {
+            heap_push(heap, &n, cursors, c);
+        }
+        c++;
+    }
+    
+    Arena scratch = { NULL, 0, -1 };
+    while (n > 0) {
+        unsigned int idx = heap[0];
+        
+        // Runs of a bucket sort before its memory, so memory on top means
+        // no run holds this key
+        if (cursors[idx].fp == NULL) {
+            heap_pop(heap, &n, cursors);
+            Key_entry* entry = cursors[idx].entry;
+            if (run_cursor_next(&cursors[idx])) {
+                heap_push(heap, &n, cursors, idx);
+            }
+            
+            reduce_iter.partition_idx = p;
+            reduce_iter.current_key = entry;
+            reduce_iter.current_value = entry->values;
+            reducer(entry->key, p);
+            continue;
+        }
+        
+        const char* key = cursors[idx].key;
+        Key_entry* merged = (Key_entry*)arena_alloc(&scratch, sizeof(Key_entry));
+        merged->key = arena_strndup(&scratch, key, strlen(key), 0);
+        merged->hash = 0;
+        merged->values = NULL;
+        merged->values_tail = NULL;
+        merged->value_count = 0;
+        merged->next = NULL;
+        
+        // Every source positioned on this key, in run order
+        while (n > 0 && strcmp(cursors[heap[0]].key, merged->key) == 0) {
+            idx = heap_pop(heap, &n, cursors);
+            run_cursor_take(&cursors[idx], merged, &scratch);
+            if (run_cursor_next(&cursors[idx])) {
+                heap_push(heap, &n, cursors, idx);
+            }
+        }
+        
+        reduce_iter.partition_idx = p;
+        reduce_iter.current_key = merged;
+        reduce_iter.current_value = merged->values;
+        reducer(merged->key, p);
+        
+        // Key done: its copied values are no longer reachable
+        reduce_iter.current_key = NULL;
+        reduce_iter.current_value = NULL;
+        arena_reset(&scratch);
+    }
+    arena_release(&scratch);
+    
+    for (unsigned int i = 0; i < k; i++) {
+        if (cursors[i].fp != NULL) {
+            free(cursors[i].key);
+            free(cursors[i].value);
+            fclose(cursors[i].fp);
+        }
+    }
+    for (unsigned int g = 0; g < group_count; g++) {
+        Partition* part = &ctx->partitions[group[g]];
+        free(part->runs);
+        part->runs = NULL;
+        part->run_count = 0;
+    }
+    free(cursors);
+    free(heap);
+}
+
+/**
+ * MR_Reduce - Wrapper function for Reduce tasks
+ * 
+ * @param threadarg: ReduceArgs structure containing partition index and reducer function
+ * 
+ * Process:
+ * 1. Extract arguments
+ * 2. Sort the keys of every bucket the partition owns
+ * 3. Iterate through all keys in partition
+ * 4. For each key, call user's Reducer function
+ * 5. Free argument structure
+ * 
+ * Note: User's Reducer calls MR_GetNext to iterate through values
+ */
+void MR_Reduce(void* threadarg) {
+    ReduceArgs* args = (ReduceArgs*)threadarg;
+    ctx = args->ctx;
+    unsigned int p = args->partition_idx;
+    Reducer reducer = args->reducer_func;
+    
+    // Buckets assigned to this partition (just p itself without balancing)
+    unsigned int* group = (unsigned int*)malloc(ctx->num_buckets * sizeof(unsigned int));
+    unsigned int group_count = 0;
+    int spilled = 0;
+    for (unsigned int b = 0; b < ctx->num_buckets; b++) {
+        if (ctx->bucket_owner[b] != p) {
+            continue;
+        }
+        group[group_count++] = b;
         
-        ThreadPool_add_job(global_threadpool,
-                          (thread_func_t)MR_Reduce,
-                          args,
-                          parts[i].size);  // SJF: job size = partition size
+        // Keep pre-sort jobs still in the queue away from this bucket
+        pthread_mutex_lock(&ctx->partitions[b].partition_mutex);
+        ctx->partitions[b].reducing = 1;
+        pthread_mutex_unlock(&ctx->partitions[b].partition_mutex);
+        
+        // Restore sorted key order (keys were inserted unsorted during Map)
+        sort_partition_keys(&ctx->partitions[b]);
+        spilled |= ctx->partitions[b].run_count > 0;
     }
     
-    free(parts);
+    // Over the memory budget during Map, or several buckets: merge them
+    Key_entry* key_entry = (group_count == 1) ? ctx->partitions[group[0]].head : NULL;
+    if (group_count > 1 || spilled) {
+        reduce_merged(group, group_count, p, reducer);
+        key_entry = NULL;
+    }
+    free(group);
+    
+    // Iterate through all keys in partition
+    while (key_entry != NULL) {
+        // Hand the reducer a cursor already positioned on this key
+        reduce_iter.partition_idx = p;
+        reduce_iter.current_key = key_entry;
+        reduce_iter.current_value = key_entry->values;
+        
+        // Call user's Reduce function
+        // User's Reducer will call MR_GetNext to iterate through values
+        reducer(key_entry->key, p);
+        
+        key_entry = key_entry->next;
+    }
     
-    // 4d. BARRIER: Wait for all Reduce jobs to complete
-    ThreadPool_check(global_threadpool);
+    // Don't leave the cursor pointing into a partition that will be freed
+    reduce_iter.current_key = NULL;
+    reduce_iter.current_value = NULL;
     
-    // ===== STEP 5: Cleanup =====
+    // One final write (and close) for everything the reducer output
+    output_close(&ctx->outputs[p]);
+    
+    // Free argument structure
+    free(args);
+}
+
+/**
+ * MR_InputOpen - Open the byte range of the running Map job
+ * 
+ * @param file_name: File the mapper was called with
+ * @return: Reader positioned at the range start, NULL if fopen fails
+ * 
+ * Outside a split job (or for another file) the reader covers the whole
+ * file, so a mapper written against this API works in both modes.
+ */
+MR_Input* MR_InputOpen(char* file_name) {
+    FILE* fp = fopen(file_name, "r");
+    if (fp == NULL) {
+        return NULL;
+    }
+    
+    MR_Input* input = (MR_Input*)malloc(sizeof(MR_Input));
+    input->fp = fp;
+    input->remaining = -1;
+    input->map = NULL;
+    input->map_length = 0;
+    
+    if (current_map != NULL && current_map->length >= 0 &&
+        strcmp(current_map->filename, file_name) == 0) {
+        if (fseeko(fp, current_map->offset, SEEK_SET) != 0) {
+            fclose(fp);
+            free(input);
+            return NULL;
+        }
+        input->remaining = current_map->length;
+    }
+    return input;
+}
+
+/**
+ * MR_InputGetline - getline(3) that stops at the end of the range
+ * 
+ * Ranges end just after a '\n' (or at EOF), so a line never straddles
+ * two jobs and only the byte budget has to be tracked.
+ */
+ssize_t MR_InputGetline(char** line, size_t* size, MR_Input* input) {
+    if (input->remaining == 0) {
+        return -1;
+    }
+    
+    ssize_t n = getline(line, size, input->fp);
+    if (n > 0 && input->remaining > 0) {
+        // Clamp in case the file grew since the split was planned
+        input->remaining = (n < input->remaining) ? input->remaining - n : 0;
+    }
+    return n;
+}
+
+/**
+ * MR_InputMap - Map the unread rest of the range into memory
+ * 
+ * @param input: Reader from MR_InputOpen
+ * @param length: Set to the number of bytes mapped
+ * @return: First byte of the range (read-only), or NULL if the file
+ *          cannot be mapped (pipes, ...) and getline has to be used
+ * 
+ * The mapping starts at the page holding the range and is hinted with
+ * MADV_SEQUENTIAL so the kernel reads ahead aggressively. The reader is
+ * consumed afterwards: MR_InputGetline returns -1.
+ */
+const char* MR_InputMap(MR_Input* input, size_t* length) {
+    int fd = fileno(input->fp);
+    off_t pos = ftello(input->fp);
+    struct stat st;
+    
+    if (input->map != NULL || pos < 0 || fstat(fd, &st) != 0 ||
+        !S_ISREG(st.st_mode)) {
+        return NULL;
+    }
+    
+    off_t avail = (st.st_size > pos) ? st.st_size - pos : 0;
+    if (input->remaining >= 0 && input->remaining < avail) {
+        avail = input->remaining;
+    }
+    *length = avail;
+    if (avail == 0) {
+        input->remaining = 0;
+        return "";
+    }
+    
+    // mmap offsets must be page aligned
+    off_t page = sysconf(_SC_PAGESIZE);
+    off_t base = pos - pos % page;
+    size_t map_length = (size_t)(pos - base) + (size_t)avail;
+    void* map = mmap(NULL, map_length, PROT_READ, MAP_PRIVATE, fd, base);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    madvise(map, map_length, MADV_SEQUENTIAL);
+    
+    input->remaining = 0;
+    input->map = map;
+    input->map_length = map_length;
+    return (const char*)map + (pos - base);
+}
+
+void MR_InputClose(MR_Input* input) {
+    if (input->map != NULL) {
+        munmap(input->map, input->map_length);
+    }
+    fclose(input->fp);
+    free(input);
+}
+
+/**
+ * find_line_end - Offset just past the first '\n' at or after pos
+ * 
+ * @param fd: Open input file
+ * @param pos: Where the scan starts
+ * @param file_size: Size from stat(), returned if no newline follows
+ */
+static off_t find_line_end(int fd, off_t pos, off_t file_size) {
+    char buf[4096];
+    
+    while (pos < file_size) {
+        ssize_t n = pread(fd, buf, sizeof(buf), pos);
+        if (n <= 0) {
+            break;
+        }
+        char* nl = memchr(buf, '\n', n);
+        if (nl != NULL) {
+            return pos + (nl - buf) + 1;
+        }
+        pos += n;
+    }
+    return file_size;
+}
+
+/**
+ * plan_splits - Cut one file into newline-aligned ranges
+ * 
+ * @param files: Growable job list, appended to
+ * @param count: Entries used in *files
+ * @param capacity: Entries allocated in *files
+ * @param filename: File to cut
+ * @param split_size: Target range size, 0 for one job per file
+ * 
+ * Each range ends just past the first newline at or after
+ * offset + split_size - 1, so ranges are at least split_size bytes
+ * (except the last) and no line is cut. Files that cannot be stat'ed,
+ * opened, or are no bigger than one range become a single whole-file
+ * job, exactly as without splitting.
+ */
+static void plan_splits(FileInfo** files, unsigned int* count,
+                        unsigned int* capacity, char* filename,
+                        unsigned long split_size) {
+    struct stat st;
+    off_t file_size = (stat(filename, &st) == 0) ? st.st_size : 0;
+    int fd = -1;
+    
+    if (split_size > 0 && (unsigned long)file_size > split_size) {
+        fd = open(filename, O_RDONLY);
+    }
+    
+    off_t start = 0;
+    do {
+        off_t end = file_size;
+        off_t length = -1;  // Whole file
+        if (fd >= 0) {
+            off_t target = start + (off_t)split_size;
+            end = (target < file_size)
+                  ? find_line_end(fd, target - 1, file_size) : file_size;
+            length = end - start;
+        }
+        
+        if (*count == *capacity) {
+            *capacity = (*capacity > 0) ? *capacity * 2 : 16;
+            *files = (FileInfo*)realloc(*files, *capacity * sizeof(FileInfo));
+        }
+        FileInfo* f = &(*files)[(*count)++];
+        f->filename = filename;
+        f->size = end - start;  // SJF: job size = bytes in the range
+        f->offset = start;
+        f->length = length;
+        
+        start = end;
+    } while (fd >= 0 && start < file_size);
+    
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+/**
+ * Run statistics (MR_Options.stats_path), gathered by MR_RunCtx
+ */
+typedef struct {
+    unsigned long long start;         // MR_RunCtx entered
+    unsigned long long split_done;    // Inputs stat'ed, split and sorted
+    unsigned long long map_end;       // Last Map job finished
+    unsigned long long reduce_start;  // Reduce jobs queued
+    unsigned long long reduce_end;    // Reduce barrier passed
+    unsigned long long end;           // Teardown finished
+} Run_times;
+
+typedef struct {
+    unsigned long keys;               // Distinct keys in memory at the end of Map
+    unsigned long pairs;              // Pairs emitted (total_pairs)
+    unsigned long long lock_wait_ns;  // Blocked time on partition_mutex
+    unsigned long lock_contended;     // Blocked acquisitions
+    unsigned int buckets;             // Buckets owned (balance > 1)
+} Partition_stats;
+
+/**
+ * write_stats - Dump the statistics of a run as one JSON object
+ * 
+ * @param times: Phase timestamps
+ * @param threads: Per-worker counters from ThreadPool_get_stats
+ * @param parts: Per-partition counters, num_parts entries
+ * 
+ * Times are integer nanoseconds so runs can be compared by tools.
+ * "-" writes to stderr.
+ */
+static void write_stats(const Run_times* times,
+                        const ThreadPool_thread_stats_t* threads, unsigned int num_workers,
+                        const Partition_stats* parts, unsigned int num_parts,
+                        unsigned int job_count, unsigned int balance,
+                        ThreadPool_policy_t policy, int pipelined) {
+    FILE* out = (strcmp(ctx->stats_path, "-") == 0) ? stderr : fopen(ctx->stats_path, "w");
+    if (out == NULL) {
+        perror(ctx->stats_path);
+        return;
+    }
+    
+    fprintf(out, "{\n  \"map_jobs\": %u, \"workers\": %u, \"partitions\": %u, "
+            "\"buckets\": %u,\n", job_count, num_workers, num_parts, num_parts * balance);
+    fprintf(out, "  \"policy\": \"%s\", \"pipeline\": %s, \"combiner\": %s,\n",
+            (policy == THREADPOOL_WORK_STEALING) ? "work_stealing" : "sjf",
+            pipelined ? "true" : "false", (ctx->active_combiner != NULL) ? "true" : "false");
     
-    // Destroy thread pool
-    ThreadPool_destroy(global_threadpool);
-    global_threadpool = NULL;
+    fprintf(out, "  \"phases_ns\": {\"split\": %llu, \"map\": %llu, \"barrier\": %llu, "
+            "\"reduce\": %llu, \"teardown\": %llu, \"total\": %llu},\n",
+            times->split_done - times->start, times->map_end - times->split_done,
+            times->reduce_start - times->map_end, times->reduce_end - times->reduce_start,
+            times->end - times->reduce_end, times->end - times->start);
+    
+    unsigned long jobs = 0;
+    unsigned long long wait_total = 0, wait_max = 0;
+    fprintf(out, "  \"threads\": [");
+    for (unsigned int i = 0; i < num_workers; i++) {
+        fprintf(out, "%s\n    {\"jobs\": %lu, \"busy_ns\": %llu, \"idle_ns\": %llu, "
+                "\"queue_wait_ns\": %llu, \"queue_wait_max_ns\": %llu}",
+                (i > 0) ? "," : "", threads[i].jobs, threads[i].busy_ns, threads[i].idle_ns,
+                threads[i].queue_wait_ns, threads[i].queue_wait_max_ns);
+        jobs += threads[i].jobs;
+        wait_total += threads[i].queue_wait_ns;
+        if (threads[i].queue_wait_max_ns > wait_max) {
+            wait_max = threads[i].queue_wait_max_ns;
+        }
+    }
+    fprintf(out, "\n  ],\n");
+    fprintf(out, "  \"queue_wait_ns\": {\"jobs\": %lu, \"total\": %llu, \"mean\": %llu, "
+            "\"max\": %llu},\n", jobs, wait_total, (jobs > 0) ? wait_total / jobs : 0, wait_max);
     
-    // Free partition data structures
+    unsigned long max_pairs = 0, sum_pairs = 0;
+    unsigned long long lock_total = 0;
+    fprintf(out, "  \"partitions\": [");
     for (unsigned int i = 0; i < num_parts; i++) {
-        Key_entry* key = partitions[i].head;
-        while (key != NULL) {
-            // Free all values for this key
-            Value_node* val = key->values;
-            while (val != NULL) {
-                Value_node* next_val = val->next;
-                free(val->value);  // Free value string
-                free(val);         // Free value node
-                val = next_val;
-            }
-            
-            Key_entry* next_key = key->next;
-            free(key->key);  // Free key string
-            free(key);       // Free key entry
-            key = next_key;
+        fprintf(out, "%s\n    {\"index\": %u, \"keys\": %lu, \"pairs\": %lu, \"buckets\": %u, "
+                "\"lock_wait_ns\": %llu, \"lock_contended\": %lu}",
+                (i > 0) ? "," : "", i, parts[i].keys, parts[i].pairs, parts[i].buckets,
+                parts[i].lock_wait_ns, parts[i].lock_contended);
+        sum_pairs += parts[i].pairs;
+        lock_total += parts[i].lock_wait_ns;
+        if (parts[i].pairs > max_pairs) {
+            max_pairs = parts[i].pairs;
+        }
+    }
+    fprintf(out, "\n  ],\n");
+    
+    // Skew: the largest Reduce job relative to a perfect split
+    double mean = (num_parts > 0) ? (double)sum_pairs / num_parts : 0.0;
+    fprintf(out, "  \"skew\": {\"max_pairs\": %lu, \"mean_pairs\": %.1f, "
+            "\"max_over_mean\": %.3f},\n", max_pairs, mean,
+            (mean > 0.0) ? max_pairs / mean : 0.0);
+    fprintf(out, "  \"lock_wait_ns\": %llu\n}\n", lock_total);
+    
+    if (out != stderr) {
+        fclose(out);
+    }
+}
+
+/**
+ * partition_init - Set up an empty partition in fresh context storage
+ */
+static void partition_init(Partition* part) {
+    memset(part, 0, sizeof(Partition));
+    part->arena.node = -1;
+    pthread_mutex_init(&part->partition_mutex, NULL);
+}
+
+/**
+ * partition_clear - Empty a partition after a run, keeping it warm
+ * 
+ * The hash index keeps its size and the arena its newest chunk, so a
+ * following run of similar size allocates (almost) nothing.
+ */
+static void partition_clear(Partition* part) {
+    for (unsigned int r = 0; r < part->run_count; r++) {
+        fclose(part->runs[r]);  // Not reduced (no reducer ran)
+    }
+    free(part->runs);
+    part->runs = NULL;
+    part->run_count = 0;
+    
+    arena_reset(&part->arena);
+    if (part->table != NULL) {
+        memset(part->table, 0, part->table_capacity * sizeof(Key_entry*));
+    }
+    part->head = NULL;
+    part->sorted_keys = NULL;
+    part->unsorted_count = 0;
+    part->reducing = 0;
+    part->spill_failed = 0;
+    part->key_count = 0;
+    part->total_pairs = 0;
+    part->lock_wait_ns = 0;
+    part->lock_contended = 0;
+}
+
+/**
+ * partition_free - Release everything a partition owns
+ */
+static void partition_free(Partition* part) {
+    partition_clear(part);
+    arena_release(&part->arena);
+    free(part->table);  // Free hash index
+    pthread_mutex_destroy(&part->partition_mutex);
+}
+
+/**
+ * MR_Context_create - Start a worker pool for any number of runs
+ * 
+ * @param num_workers: Number of threads in the pool
+ * @param options: Pool settings (work_stealing, pin_workers), NULL for defaults
+ * @return: New context, NULL if the pool could not be started
+ */
+MR_Context* MR_Context_create(unsigned int num_workers, const MR_Options* options) {
+    MR_Context* context = (MR_Context*)calloc(1, sizeof(MR_Context));
+    if (context == NULL) {
+        return NULL;
+    }
+    
+    context->num_workers = num_workers;
+    context->policy = (options != NULL && options->work_stealing)
+                      ? THREADPOOL_WORK_STEALING : THREADPOOL_SJF;
+    context->pin_workers = (options != NULL && options->pin_workers && num_workers > 0);
+    context->threadpool = ThreadPool_create_ex(num_workers, context->policy,
+                                               context->pin_workers);
+    if (context->threadpool == NULL) {
+        free(context);
+        return NULL;
+    }
+    
+    // Binding arenas only pays off if the workers span several nodes
+    for (unsigned int i = 1; context->pin_workers && i < num_workers; i++) {
+        int node = ThreadPool_worker_node(context->threadpool, i);
+        if (node >= 0 && node != ThreadPool_worker_node(context->threadpool, 0)) {
+            context->numa_placement = 1;
+            break;
+        }
+    }
+    atomic_init(&context->maps_pending, 0);
+    return context;
+}
+
+/**
+ * MR_Context_destroy - Stop the pool and free the context's storage
+ * 
+ * @param context: Context from MR_Context_create (not running)
+ */
+void MR_Context_destroy(MR_Context* context) {
+    ThreadPool_destroy(context->threadpool);
+    
+    for (unsigned int i = 0; i < context->bucket_capacity; i++) {
+        partition_free(&context->partitions[i]);
+    }
+    free(context->partitions);
+    free(context->bucket_owner);
+    free(context->outputs);
+    free(context);
+}
+
+/**
+ * reserve_storage - Make room for the buckets and sinks of a run
+ * 
+ * Storage only grows; a larger run replaces it (mutexes are not moved,
+ * the old partitions are freed and new ones initialized).
+ */
+static void reserve_storage(unsigned int num_parts) {
+    if (ctx->bucket_capacity < ctx->num_buckets) {
+        for (unsigned int i = 0; i < ctx->bucket_capacity; i++) {
+            partition_free(&ctx->partitions[i]);
+        }
+        free(ctx->partitions);
+        free(ctx->bucket_owner);
+        
+        ctx->partitions = (Partition*)malloc(ctx->num_buckets * sizeof(Partition));
+        ctx->bucket_owner = (unsigned int*)malloc(ctx->num_buckets * sizeof(unsigned int));
+        for (unsigned int i = 0; i < ctx->num_buckets; i++) {
+            partition_init(&ctx->partitions[i]);
+        }
+        ctx->bucket_capacity = ctx->num_buckets;
+    }
+    
+    if (ctx->output_capacity < num_parts) {
+        free(ctx->outputs);
+        ctx->outputs = (Output_sink*)malloc(num_parts * sizeof(Output_sink));
+        for (unsigned int i = 0; i < num_parts; i++) {
+            ctx->outputs[i].fd = -1;
+            ctx->outputs[i].buffer = NULL;
+            ctx->outputs[i].used = 0;
+        }
+        ctx->output_capacity = num_parts;
+    }
+    
+    for (unsigned int i = 0; i < ctx->num_buckets; i++) {
+        ctx->bucket_owner[i] = i % num_parts;  // Until assign_buckets runs
+        ctx->partitions[i].arena.node = ctx->numa_placement
+            ? ThreadPool_worker_node(ctx->threadpool, home_worker(ctx->bucket_owner[i]))
+            : -1;
+    }
+}
+
+/**
+ * MR_RunCtx - Main MapReduce orchestrator
+ * 
+ * @param context: Context whose pool and storage the run uses
+ * @param file_count: Number of input files
+ * @param file_names: Array of filename strings
+ * @param mapper: User's Map function
+ * @param reducer: User's Reduce function
+ * @param num_parts: Number of partitions (P)
+ * @param options: Extra options (combiner, splitting, ...), NULL for defaults;
+ *                 work_stealing is fixed by MR_Context_create
+ * 
+ * Execution Flow:
+ * 1. Size partitions (reusing the context's storage)
+ * 2. MAP PHASE: Split files into ranges, sort by size, submit Map jobs (SJF)
+ * 3. BARRIER: ThreadPool_check() waits for all Map jobs
+ * 4. REDUCE PHASE: Sort partitions by size, submit Reduce jobs (SJF)
+ * 5. BARRIER: ThreadPool_check() waits for all Reduce jobs
+ * With options->pipeline, steps 3-4 happen inside the pool instead:
+ * the last Map job queues the Reduce jobs (see map_job_done)
+ * 6. Cleanup: Empty every partition for the next run
+ * 
+ * Synchronization:
+ * - ThreadPool_check() provides barrier between Map and Reduce
+ * - Partition mutexes protect concurrent MR_Emit calls
+ * - Same thread pool used for both phases and for later runs
+ * - Different contexts share nothing; one context runs one job at a time
+ * 
+ * Memory Management:
+ * - Keys and values are dropped after the run, arenas keep one chunk
+ * - Everything else is freed by MR_Context_destroy
+ */
+void MR_RunCtx(MR_Context* context, unsigned int file_count, char* file_names[],
+               Mapper mapper, Reducer reducer, unsigned int num_parts,
+               const MR_Options* options) {
+    // The calling thread works for this context until the run is over
+    MR_Context* caller_ctx = ctx;
+    ctx = context;
+    
+    ctx->num_partitions = num_parts;
+    ctx->active_combiner = (options != NULL) ? options->combiner : NULL;
+    ctx->output_pattern = (options != NULL && options->output_pattern != NULL)
+                     ? options->output_pattern : "result-%d.txt";
+    
+    // Key placement: balance > 1 hashes into more buckets than partitions,
+    // unless a user partitioner decides the partition itself
+    ctx->user_partitioner = (options != NULL) ? options->partitioner : NULL;
+    ctx->use_fast_hash = (options != NULL && options->fast_hash);
+    unsigned int balance = (options != NULL && options->balance > 1 &&
+                            ctx->user_partitioner == NULL) ? options->balance : 1;
+    ctx->num_buckets = num_parts * balance;
+    
+    // Split the budget evenly; keep at least one arena chunk per bucket
+    ctx->spill_limit = 0;
+    if (options != NULL && options->memory_budget > 0) {
+        ctx->spill_limit = options->memory_budget / ctx->num_buckets;
+        if (ctx->spill_limit < ARENA_CHUNK_SIZE) {
+            ctx->spill_limit = ARENA_CHUNK_SIZE;
+        }
+    }
+    ctx->spill_dir = (options != NULL && options->spill_dir != NULL) ? options->spill_dir
+                : (getenv("TMPDIR") != NULL) ? getenv("TMPDIR") : "/tmp";
+    
+    // Statistics: option first, environment for programs using MR_Run
+    ctx->stats_path = (options != NULL && options->stats_path != NULL) ? options->stats_path
+                 : getenv("MR_STATS");
+    if (ctx->stats_path != NULL && ctx->stats_path[0] == '\0') {
+        ctx->stats_path = NULL;
+    }
+    Run_times times = { 0 };
+    times.start = (ctx->stats_path != NULL) ? now_ns() : 0;
+    ctx->map_end_ns = 0;
+    
+    // ===== STEP 1: Initialize Partitions =====
+    reserve_storage(num_parts);
+    
+    // ===== STEP 2: Thread Pool (persistent) =====
+    unsigned int num_workers = ctx->num_workers;
+    if (ctx->stats_path != NULL) {
+        ThreadPool_set_stats(ctx->threadpool, true);
+    }
+    
+    // ===== STEP 3: MAP PHASE with SJF =====
+    
+    // 3a. Get file (or range) sizes for SJF scheduling
+    unsigned long split_size = (options != NULL) ? options->split_size : 0;
+    FileInfo* files = NULL;
+    unsigned int job_count = 0;
+    unsigned int job_capacity = 0;
+    for (unsigned int i = 0; i < file_count; i++) {
+        plan_splits(&files, &job_count, &job_capacity, file_names[i], split_size);
+    }
+    
+    // 3b. Sort jobs by size (ascending for SJF)
+    if (job_count > 0) {
+        qsort(files, job_count, sizeof(FileInfo), compare_file_size);
+    }
+    
+    if (ctx->stats_path != NULL) {
+        times.split_done = now_ns();
+    }
+    
+    // 3c. Pipelined: the last Map job queues the Reduce jobs (map_job_done)
+    ctx->pipeline_enabled = (options != NULL && options->pipeline && job_count > 0);
+    ctx->active_reducer = reducer;
+    atomic_store(&ctx->maps_pending, job_count);
+    ctx->presort_trigger = ((job_count < num_workers) ? job_count : num_workers) - 1;
+    
+    // 3d. Submit Map jobs to thread pool (in SJF order)
+    for (unsigned int i = 0; i < job_count; i++) {
+        MapArgs* args = (MapArgs*)malloc(sizeof(MapArgs));
+        args->ctx = ctx;
+        args->filename = files[i].filename;
+        args->mapper_func = mapper;
+        args->offset = files[i].offset;
+        args->length = files[i].length;
+        
+        ThreadPool_add_job(ctx->threadpool, 
+                          (thread_func_t)MR_Map,
+                          args,
+                          files[i].size);  // SJF: job size = range size
+    }
+    
+    free(files);
+    
+    // ===== STEP 4: REDUCE PHASE with SJF =====
+    if (!ctx->pipeline_enabled) {
+        // 4a. BARRIER: Wait for all Map jobs to complete
+        ThreadPool_check(ctx->threadpool);
+        times.reduce_start = (ctx->stats_path != NULL) ? now_ns() : 0;
+        
+        // 4b. Submit Reduce jobs (sorted by partition size)
+        submit_reduce_jobs(reducer);
+    }
+    
+    // 4c. BARRIER: Wait for all Reduce jobs to complete
+    ThreadPool_check(ctx->threadpool);
+    int pipelined = ctx->pipeline_enabled;
+    ctx->pipeline_enabled = 0;
+    ctx->active_reducer = NULL;
+    
+    // Snapshot counters that are cleared below
+    ThreadPool_thread_stats_t* thread_stats = NULL;
+    Partition_stats* part_stats = NULL;
+    if (ctx->stats_path != NULL) {
+        times.reduce_end = now_ns();
+        // No Map jobs: the Map phase ended as it started
+        times.map_end = (ctx->map_end_ns != 0) ? ctx->map_end_ns : times.split_done;
+        if (pipelined || times.reduce_start < times.map_end) {
+            times.reduce_start = times.map_end;  // Last Map job queued Reduce itself
         }
         
-        pthread_mutex_destroy(&partitions[i].partition_mutex);
+        thread_stats = (ThreadPool_thread_stats_t*)calloc(num_workers,
+                                                          sizeof(ThreadPool_thread_stats_t));
+        ThreadPool_get_stats(ctx->threadpool, thread_stats, num_workers);
+        ThreadPool_set_stats(ctx->threadpool, false);
+        part_stats = (Partition_stats*)calloc(num_parts, sizeof(Partition_stats));
+        for (unsigned int b = 0; b < ctx->num_buckets; b++) {
+            Partition_stats* ps = &part_stats[ctx->bucket_owner[b]];
+            ps->keys += ctx->partitions[b].key_count;
+            ps->pairs += ctx->partitions[b].total_pairs;
+            ps->lock_wait_ns += ctx->partitions[b].lock_wait_ns;
+            ps->lock_contended += ctx->partitions[b].lock_contended;
+            ps->buckets++;
+        }
+    }
+    
+    // ===== STEP 5: Cleanup =====
+    
+    // MR_Output used outside a reducer
+    for (unsigned int i = 0; i < num_parts; i++) {
+        output_close(&ctx->outputs[i]);
+    }
+    
+    // Empty the partitions (one arena reset per bucket, no per-node walk)
+    for (unsigned int i = 0; i < ctx->num_buckets; i++) {
+        partition_clear(&ctx->partitions[i]);
+    }
+    
+    if (ctx->stats_path != NULL) {
+        times.end = now_ns();
+        write_stats(&times, thread_stats, num_workers, part_stats, num_parts,
+                    job_count, balance, ctx->policy, pipelined);
+        free(thread_stats);
+        free(part_stats);
+        ctx->stats_path = NULL;
     }
+    ctx->num_buckets = 0;
+    ctx->user_partitioner = NULL;
+    ctx->use_fast_hash = 0;
+    ctx->active_combiner = NULL;
     
-    free(partitions);
-    free(iterators);
-    partitions = NULL;
-    iterators = NULL;
+    ctx = caller_ctx;
+}
+
+/**
+ * MR_RunEx - One run on a context of its own
+ * 
+ * Memory Management:
+ * - All dynamically allocated memory freed before return
+ * - Valgrind clean (no leaks)
+ */
+void MR_RunEx(unsigned int file_count, char* file_names[],
+              Mapper mapper, Reducer reducer,
+              unsigned int num_workers, unsigned int num_parts,
+              const MR_Options* options) {
+    MR_Context* context = MR_Context_create(num_workers, options);
+    if (context == NULL) {
+        return;
+    }
+    MR_RunCtx(context, file_count, file_names, mapper, reducer, num_parts, options);
+    MR_Context_destroy(context);
+}
+
+/**
+ * MR_Run - Original entry point: MR_RunEx with default options
+ */
+void MR_Run(unsigned int file_count, char* file_names[],
+            Mapper mapper, Reducer reducer,
+            unsigned int num_workers, unsigned int num_parts) {
+    MR_RunEx(file_count, file_names, mapper, reducer,
+             num_workers, num_parts, NULL);
 }
\ No newline at end of file
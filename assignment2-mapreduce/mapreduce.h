@@ -3,6 +3,9 @@
 #ifndef MAPREDUCE_H
 #define MAPREDUCE_H
 
+#include <stddef.h>
+#include <sys/types.h>
+
 // typedefs
 typedef void (*Mapper)(char* file_name);
 typedef void (*Reducer)(char* key, unsigned int partition_idx);
@@ -60,4 +63,185 @@ void MR_Reduce(void* threadarg);
 */
 char* MR_GetNext(char* key, unsigned int partition_idx);
 
+// ------------------------------------------------------------------------
+// Extensions. Everything above keeps its original contract; MR_Run is
+// equivalent to MR_RunEx with options == NULL.
+// ------------------------------------------------------------------------
+
+/**
+* Zero-copy variant of MR_GetNext
+* Parameters:
+*     key           - Key of the values being reduced
+*     partition_idx - Index of the partition containing this key
+*     length        - Set to the length of the returned value (may be NULL)
+* Return:
+*     const char *  - Borrowed value; do not free, valid until the reducer returns
+*     NULL          - No more values for this key
+*/
+const char* MR_GetNextView(char* key, unsigned int partition_idx, size_t* length);
+
+/**
+* Get the number of values stored for a key without iterating them
+* Parameters:
+*     key           - Key of the values being reduced
+*     partition_idx - Index of the partition containing this key
+* Return:
+*     unsigned long - Values MR_GetNext would return (1 per key with a combiner)
+*/
+unsigned long MR_GetCount(char* key, unsigned int partition_idx);
+
+// Size of the buffer a Combiner folds into (including the '\0')
+#define MR_COMBINE_VALUE_MAX 32
+
+/**
+* Fold a value into the running value of its key (e.g. add two counts)
+* Parameters:
+*     key           - Key both values belong to
+*     acc           - Running value, updated in place; holds up to
+*                     MR_COMBINE_VALUE_MAX bytes including the '\0'
+*     value         - Value being folded into acc
+*/
+typedef void (*Combiner)(char* key, char* acc, char* value);
+
+// Same contract as MR_Partitioner; used by MR_RunEx in its place
+typedef unsigned int (*Partitioner)(char* key, unsigned int num_partitions);
+
+// Optional knobs for MR_RunEx; zero-initialize to get MR_Run behaviour
+typedef struct {
+    Combiner combiner;   // Pre-aggregates values per key (NULL = keep all)
+    int work_stealing;   // Nonzero: per-worker deques instead of the SJF queue
+    unsigned long split_size; // Nonzero: cut files into newline-aligned
+                              // ranges of about this many bytes, one Map
+                              // job each (read them with MR_InputOpen)
+    const char* output_pattern; // File name format for MR_Output, with one
+                                // %d for the partition (NULL = "result-%d.txt")
+    unsigned long memory_budget; // Nonzero: bytes of intermediate data kept in
+                                 // RAM (split over partitions); a partition
+                                 // over its share is spilled to a sorted run file
+    const char* spill_dir;       // Directory for run files (NULL = $TMPDIR or /tmp)
+    int pipeline;                // Nonzero: no Map barrier; idle workers pre-sort
+                                 // partitions and the last Map job queues Reduce
+    Partitioner partitioner;     // Picks the partition of a key, called with num_parts
+                                 // (NULL = MR_Partitioner); overrides balance
+    int fast_hash;               // Nonzero: word-at-a-time hash instead of DJB2
+                                 // (keys land in other partitions than MR_Partitioner)
+    unsigned int balance;        // >1: hash into balance * num_parts buckets and
+                                 // hand them to reducers by pair count after Map
+                                 // (ignored when partitioner is set)
+    const char* stats_path;      // Write run statistics (JSON) to this file, "-" for
+                                 // stderr (NULL = $MR_STATS, unset = no stats)
+    int pin_workers;             // Nonzero: pin worker i to the i-th allowed CPU and
+                                 // keep partition p's storage and Reduce job on the
+                                 // NUMA node of worker p % num_workers
+} MR_Options;
+
+/**
+* Run the MapReduce framework with extra options
+* Parameters:
+*     file_count .. num_parts - Same as MR_Run
+*     options      - Extra options, or NULL for defaults
+*/
+void MR_RunEx(unsigned int file_count, char* file_names[],
+              Mapper mapper, Reducer reducer,
+              unsigned int num_workers, unsigned int num_parts,
+              const MR_Options* options);
+
+/**
+* MR_Emit for a key that is not NUL-terminated (e.g. a token inside
+* MR_InputMap's buffer)
+* Parameters:
+*     key           - First byte of the key
+*     key_len       - Length of the key
+*     value         - Value of the output
+*/
+void MR_EmitN(const char* key, size_t key_len, char* value);
+
+/**
+* Append "<key>: <value>\n" to the result file of a partition; output is
+* buffered and written when the partition's Reduce job ends
+* Parameters:
+*     partition_idx - Partition the calling reducer is processing
+*     key           - Key of the result
+*     value         - Result value
+*/
+void MR_Output(unsigned int partition_idx, const char* key, const char* value);
+
+// Reader over the part of a file assigned to the current Map job
+typedef struct MR_Input MR_Input;
+
+/**
+* Open the input of the calling Map job
+* Parameters:
+*     file_name     - File name the mapper was called with
+* Return:
+*     MR_Input *    - Reader limited to this job's byte range (the whole
+*                     file when splitting is off)
+*     NULL          - The file could not be opened
+*/
+MR_Input* MR_InputOpen(char* file_name);
+
+/**
+* Read the next line of the job's range, same contract as getline(3)
+* Parameters:
+*     line          - Buffer, (re)allocated as needed; caller frees it
+*     size          - Capacity of *line
+*     input         - Reader from MR_InputOpen
+* Return:
+*     ssize_t       - Bytes read including the '\n', or -1 at the end of the range
+*/
+ssize_t MR_InputGetline(char** line, size_t* size, MR_Input* input);
+
+/**
+* Map the unread rest of the job's range into memory (read-only)
+* Parameters:
+*     input         - Reader from MR_InputOpen
+*     length        - Set to the number of bytes returned
+* Return:
+*     const char *  - Range contents, not NUL-terminated; valid until
+*                     MR_InputClose. The reader is consumed afterwards
+*     NULL          - Input cannot be mapped; read it with MR_InputGetline
+*/
+const char* MR_InputMap(MR_Input* input, size_t* length);
+
+/**
+* Close a reader from MR_InputOpen
+* Parameters:
+*     input         - Reader to close
+*/
+void MR_InputClose(MR_Input* input);
+
+// Worker pool and partition storage kept across runs; see MR_Context_create
+typedef struct MR_Context MR_Context;
+
+/**
+* Create a context: a thread pool and storage reused by every MR_RunCtx
+* Parameters:
+*     num_workers   - Number of threads in the pool
+*     options       - Pool settings (work_stealing, pin_workers), or NULL
+* Return:
+*     MR_Context *  - New context
+*     NULL          - The pool could not be started
+*/
+MR_Context* MR_Context_create(unsigned int num_workers, const MR_Options* options);
+
+/**
+* Run the MapReduce framework on a context; several contexts may run at
+* the same time, but one context runs one MR_RunCtx at a time
+* Parameters:
+*     context       - Context from MR_Context_create
+*     file_count .. reducer - Same as MR_Run
+*     num_parts     - Number of partitions to be created
+*     options       - Same as MR_RunEx (work_stealing is set by the context)
+*/
+void MR_RunCtx(MR_Context* context, unsigned int file_count, char* file_names[],
+               Mapper mapper, Reducer reducer, unsigned int num_parts,
+               const MR_Options* options);
+
+/**
+* Stop the context's threads and free its storage
+* Parameters:
+*     context       - Context from MR_Context_create, not running
+*/
+void MR_Context_destroy(MR_Context* context);
+
 #endif
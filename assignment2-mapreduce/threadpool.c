@@ -3,19 +3,75 @@
  * 
  * This library implements a fixed-size thread pool with:
  * - Shortest Job First (SJF) scheduling policy
+ * - Optional work-stealing policy (per-worker Chase-Lev deques)
  * - POSIX mutex and condition variable synchronization
- * - Barrier synchronization for phase completion
+ * - Barrier synchronization for phase completion (atomic counter + futex)
+ * - Bounded, adaptive spinning before an idle worker parks
+ * - Optional per-thread busy/idle and queue latency statistics
+ * - Optional CPU pinning with NUMA-node-aware stealing
  * 
  * Key Components:
  * - Worker threads that continuously process jobs from a queue
  * - SJF-ordered job queue (sorted by job size)
+ * - Work stealing: external jobs go to per-worker inboxes, workers run
+ *   their own deque and steal from random victims when it runs dry
  * - Synchronization primitives for thread-safe operations
  */
 
+#define _GNU_SOURCE  // pthread_setaffinity_np, sched_getaffinity
 #include "threadpool.h"
+#include <sched.h>
+#include <dirent.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdatomic.h>
 #include <sys/stat.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// Initial number of slots in a work-stealing deque (power of two)
+#define DEQUE_INIT_SIZE 64
+
+// Bounds of an idle worker's spin budget (pause iterations before parking)
+#define SPIN_MIN 64
+#define SPIN_MAX 8192
+
+/**
+ * Circular array backing a Chase-Lev deque
+ * Replaced arrays are kept on the prev chain until ThreadPool_destroy,
+ * since a thief may still be reading from one.
+ */
+typedef struct Deque_array {
+    long size;                                 // Number of slots (power of two)
+    struct Deque_array* prev;                  // Older, retired array
+    _Atomic(ThreadPool_job_t*) buffer[];       // Job slots
+} Deque_array;
+
+/**
+ * Chase-Lev work-stealing deque
+ * - Owner pushes and takes at bottom (LIFO)
+ * - Thieves steal at top (FIFO)
+ */
+typedef struct {
+    atomic_long top;                 // Next index thieves steal from
+    atomic_long bottom;              // Next index the owner pushes to
+    _Atomic(Deque_array*) array;     // Current backing array
+} WS_deque;
+
+/**
+ * Per-worker state for the work-stealing policy
+ */
+typedef struct {
+    WS_deque deque;                  // Jobs owned by this worker
+    pthread_mutex_t inbox_mutex;     // Protects inbox (jobs from non-workers)
+    ThreadPool_job_t* inbox_head;    // Submitted jobs, in submission order
+    ThreadPool_job_t* inbox_tail;
+    unsigned int rng;                // xorshift state for victim selection
+} ThreadPool_worker;
 
 /**
  * Enhanced ThreadPool structure with synchronization primitives
@@ -23,34 +79,574 @@
 typedef struct ThreadPool_work {
     pthread_t* threads;              // Array of worker thread handles
     ThreadPool_job_queue_t jobs;     // Job queue (SJF-ordered)
+    ThreadPool_policy_t policy;      // Scheduling policy
     
     // SYNCHRONIZATION PRIMITIVES
     pthread_mutex_t queue_mutex;     // Protects job queue and state variables
     pthread_cond_t jobs_available;   // Signals when jobs are added to queue
-    pthread_cond_t jobs_done;        // Signals when all work is complete
     
-    // STATE TRACKING
+    // STATE TRACKING (atomic: read without queue_mutex)
     unsigned int num_threads;        // Total number of worker threads
-    unsigned int active_threads;     // Number of threads currently executing jobs
-    unsigned int pending_jobs;       // Number of jobs in queue (same as jobs.size)
+    unsigned int num_started;        // Threads actually created (joined on destroy)
+    atomic_uint active_threads;      // Number of threads currently executing jobs
+    atomic_uint pending_jobs;        // Number of jobs in queue (same as jobs.size)
+    atomic_long outstanding;         // Jobs submitted but not yet finished (barrier)
+    atomic_int sleeping;             // Workers parked on jobs_available
     bool shutdown;                   // Flag to signal threads to exit
+    
+    // BARRIER (eventcount: ThreadPool_check sleeps on done_seq with a futex)
+    atomic_uint done_seq;            // Bumped each time outstanding drops to 0
+    atomic_int check_waiters;        // Threads inside ThreadPool_check
+    unsigned int spin_max;           // Largest spin budget (0 on a single CPU)
+    
+    // WORK STEALING (policy == THREADPOOL_WORK_STEALING only)
+    ThreadPool_worker* workers;      // One deque + inbox per thread
+    atomic_uint next_worker_id;      // Hands out worker indices in Thread_run
+    atomic_uint next_inbox;          // Round-robin target for external jobs
+    atomic_long queued;              // Jobs submitted but not yet picked up
+    
+    // STATISTICS (ThreadPool_set_stats)
+    atomic_int stats_enabled;        // Nonzero once enabled
+    unsigned long long stats_start;  // Time stats were enabled (start of idle time)
+    ThreadPool_thread_stats_t* stats; // One entry per worker, written by that worker only
+    
+    // PLACEMENT (ThreadPool_create_ex with pin)
+    int* worker_cpu;                 // CPU of each worker id, NULL when not pinned
+    int* worker_node;                // NUMA node of each worker id (-1 unknown)
 } ThreadPool_work;
 
+// Pool and worker slot of the calling thread (NULL outside worker threads)
+static __thread ThreadPool_work* current_pool = NULL;
+static __thread ThreadPool_worker* current_worker = NULL;
+
+/* ========================================================================
+ * STATISTICS
+ * ======================================================================== */
+
+/**
+ * now_ns - Monotonic clock in nanoseconds
+ */
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+/**
+ * run_job - Execute and free a job, recording stats for worker id
+ * 
+ * @param idle_since: Worker's end time of its previous job (0 = none yet),
+ *                    advanced to the end of this one
+ * 
+ * Counters are written before the job is reported finished, so the
+ * thread returning from ThreadPool_check sees them.
+ */
+static void run_job(ThreadPool_work* pool, unsigned int id, ThreadPool_job_t* job,
+                    unsigned long long* idle_since) {
+    if (!atomic_load_explicit(&pool->stats_enabled, memory_order_acquire)) {
+        job->func(job->arg);
+        free(job);
+        return;
+    }
+    
+    ThreadPool_thread_stats_t* s = &pool->stats[id];
+    unsigned long long start = now_ns();
+    unsigned long long idle_from = (*idle_since > pool->stats_start) ? *idle_since
+                                                                     : pool->stats_start;
+    if (start > idle_from) {
+        s->idle_ns += start - idle_from;
+    }
+    if (job->submit_ns != 0 && start > job->submit_ns) {
+        unsigned long long wait = start - job->submit_ns;
+        s->queue_wait_ns += wait;
+        if (wait > s->queue_wait_max_ns) {
+            s->queue_wait_max_ns = wait;
+        }
+    }
+    
+    job->func(job->arg);
+    free(job);
+    
+    *idle_since = now_ns();
+    s->busy_ns += *idle_since - start;
+    s->jobs++;
+}
+
+/* ========================================================================
+ * WAKEUP AND BARRIER
+ * ======================================================================== */
+
+/**
+ * cpu_relax - Tell the CPU we are busy-waiting
+ */
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
+/**
+ * spin_for_work - Busy-wait briefly for a job before parking
+ * 
+ * @param budget: Caller's spin budget, adapted to how spinning pays off:
+ *                doubled when a job turned up, halved when none did
+ * @return: true if a job was queued while spinning
+ * 
+ * With many tiny jobs the next one usually arrives within microseconds,
+ * much less than a park and wakeup through queue_mutex and the condition
+ * variable. Skipped on a single CPU, where spinning only delays the
+ * thread that would submit the job.
+ */
+static bool spin_for_work(ThreadPool_work* pool, unsigned int* budget) {
+    if (pool->spin_max == 0) {
+        return false;
+    }
+    
+    for (unsigned int i = 0; i < *budget; i++) {
+        bool ready = (pool->policy == THREADPOOL_WORK_STEALING)
+                     ? atomic_load_explicit(&pool->queued, memory_order_relaxed) > 0
+                     : atomic_load_explicit(&pool->pending_jobs, memory_order_relaxed) > 0;
+        if (ready) {
+            *budget = (*budget * 2 < pool->spin_max) ? *budget * 2 : pool->spin_max;
+            return true;
+        }
+        cpu_relax();
+    }
+    *budget = (*budget / 2 > SPIN_MIN) ? *budget / 2 : SPIN_MIN;
+    return false;
+}
+
+/**
+ * futex_wait - Sleep while *word == expected (or until woken)
+ */
+static void futex_wait(atomic_uint* word, unsigned int expected) {
+    syscall(SYS_futex, (unsigned int*)word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+/**
+ * futex_wake - Wake every thread sleeping on word
+ */
+static void futex_wake(atomic_uint* word) {
+    syscall(SYS_futex, (unsigned int*)word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/**
+ * finish_job - Account for a completed job and release the barrier
+ * 
+ * Lock-free: the last outstanding job bumps done_seq and only makes the
+ * futex call if some thread is inside ThreadPool_check. The seq_cst
+ * order of outstanding/done_seq here and check_waiters/done_seq/
+ * outstanding there means a waiter either sees outstanding == 0 or is
+ * seen (and woken, or its futex_wait finds done_seq changed).
+ */
+static void finish_job(ThreadPool_work* pool) {
+    if (atomic_fetch_sub(&pool->outstanding, 1) == 1) {
+        atomic_fetch_add(&pool->done_seq, 1);
+        if (atomic_load(&pool->check_waiters) > 0) {
+            futex_wake(&pool->done_seq);
+        }
+    }
+}
+
+/* ========================================================================
+ * PLACEMENT
+ * ======================================================================== */
+
+/**
+ * cpu_node - NUMA node of a CPU, from its nodeN link in sysfs
+ * @return: Node number, or -1 if the system does not report one
+ */
+static int cpu_node(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR* dir = opendir(path);
+    if (dir == NULL) {
+        return -1;
+    }
+    
+    int node = -1;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 &&
+            entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+/**
+ * plan_placement - Give each worker id a CPU (and its node)
+ * 
+ * Worker i gets the i-th CPU the process may run on, wrapping around
+ * when there are more workers than CPUs, so consecutive workers share
+ * a node as far as possible.
+ * @return: true, or false if the CPU set could not be read
+ */
+static bool plan_placement(ThreadPool_work* pool) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+        return false;
+    }
+    
+    int count = CPU_COUNT(&allowed);
+    int* cpus = (int*)malloc(count * sizeof(int));
+    for (int cpu = 0, n = 0; cpu < CPU_SETSIZE && n < count; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            cpus[n++] = cpu;
+        }
+    }
+    
+    pool->worker_cpu = (int*)malloc(pool->num_threads * sizeof(int));
+    pool->worker_node = (int*)malloc(pool->num_threads * sizeof(int));
+    for (unsigned int i = 0; i < pool->num_threads; i++) {
+        pool->worker_cpu[i] = cpus[i % count];
+        pool->worker_node[i] = cpu_node(pool->worker_cpu[i]);
+    }
+    free(cpus);
+    return true;
+}
+
+/**
+ * pin_self - Bind the calling worker to its planned CPU (best effort)
+ */
+static void pin_self(ThreadPool_work* pool, unsigned int id) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(pool->worker_cpu[id], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/* ========================================================================
+ * CHASE-LEV DEQUE
+ * ======================================================================== */
+
+/**
+ * deque_init - Allocate the initial backing array of a deque
+ */
+static void deque_init(WS_deque* q) {
+    Deque_array* a = (Deque_array*)calloc(1, sizeof(Deque_array) +
+                                          DEQUE_INIT_SIZE * sizeof(ThreadPool_job_t*));
+    a->size = DEQUE_INIT_SIZE;
+    a->prev = NULL;
+    atomic_init(&q->top, 0);
+    atomic_init(&q->bottom, 0);
+    atomic_init(&q->array, a);
+}
+
+/**
+ * deque_free - Release a deque's current and retired arrays
+ */
+static void deque_free(WS_deque* q) {
+    Deque_array* a = atomic_load_explicit(&q->array, memory_order_relaxed);
+    while (a != NULL) {
+        Deque_array* prev = a->prev;
+        free(a);
+        a = prev;
+    }
+}
+
+/**
+ * deque_push - Owner: push a job at the bottom, growing the array if full
+ */
+static void deque_push(WS_deque* q, ThreadPool_job_t* job) {
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    Deque_array* a = atomic_load_explicit(&q->array, memory_order_relaxed);
+    
+    if (b - t > a->size - 1) {
+        // Full: copy live range into an array twice the size
+        Deque_array* bigger = (Deque_array*)malloc(sizeof(Deque_array) +
+                                                   2 * a->size * sizeof(ThreadPool_job_t*));
+        bigger->size = 2 * a->size;
+        bigger->prev = a;
+        for (long i = t; i < b; i++) {
+            atomic_store_explicit(&bigger->buffer[i & (bigger->size - 1)],
+                                  atomic_load_explicit(&a->buffer[i & (a->size - 1)],
+                                                       memory_order_relaxed),
+                                  memory_order_relaxed);
+        }
+        atomic_store_explicit(&q->array, bigger, memory_order_release);
+        a = bigger;
+    }
+    
+    atomic_store_explicit(&a->buffer[b & (a->size - 1)], job, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+}
+
+/**
+ * deque_take - Owner: pop the most recently pushed job
+ * @return: Job, or NULL if the deque is empty (or a thief won the last one)
+ */
+static ThreadPool_job_t* deque_take(WS_deque* q) {
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+    Deque_array* a = atomic_load_explicit(&q->array, memory_order_relaxed);
+    atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&q->top, memory_order_relaxed);
+    
+    ThreadPool_job_t* job = NULL;
+    if (t <= b) {
+        job = atomic_load_explicit(&a->buffer[b & (a->size - 1)], memory_order_relaxed);
+        if (t == b) {
+            // Last job: race thieves for it
+            if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                                                         memory_order_seq_cst,
+                                                         memory_order_relaxed)) {
+                job = NULL;
+            }
+            atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+        }
+    } else {
+        // Empty: restore bottom
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    }
+    return job;
+}
+
+/**
+ * deque_steal - Thief: take the oldest job
+ * @param out: Set to the stolen job on success
+ * @return: 1 on success, 0 if empty, -1 if another thread won the race
+ */
+static int deque_steal(WS_deque* q, ThreadPool_job_t** out) {
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+    
+    if (t >= b) {
+        return 0;
+    }
+    
+    Deque_array* a = atomic_load_explicit(&q->array, memory_order_acquire);
+    ThreadPool_job_t* job = atomic_load_explicit(&a->buffer[t & (a->size - 1)],
+                                                 memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+        return -1;
+    }
+    *out = job;
+    return 1;
+}
+
+/* ========================================================================
+ * WORK-STEALING SCHEDULER
+ * ======================================================================== */
+
+/**
+ * inbox_pop - Remove the oldest job from a worker's inbox
+ * @return: Job, or NULL if the inbox is empty
+ */
+static ThreadPool_job_t* inbox_pop(ThreadPool_worker* w) {
+    pthread_mutex_lock(&w->inbox_mutex);
+    ThreadPool_job_t* job = w->inbox_head;
+    if (job != NULL) {
+        w->inbox_head = job->next;
+        if (w->inbox_head == NULL) {
+            w->inbox_tail = NULL;
+        }
+    }
+    pthread_mutex_unlock(&w->inbox_mutex);
+    return job;
+}
+
+/**
+ * drain_inbox - Move a worker's inbox into its own deque
+ * 
+ * Inbox jobs arrive in submission order (ascending size when the caller
+ * presorts, as MR_Run does). They are pushed largest-first so the owner's
+ * LIFO take returns the smallest job first (SJF hint), while thieves
+ * steal the largest remaining job from the top.
+ */
+static void drain_inbox(ThreadPool_worker* w) {
+    pthread_mutex_lock(&w->inbox_mutex);
+    ThreadPool_job_t* list = w->inbox_head;
+    w->inbox_head = NULL;
+    w->inbox_tail = NULL;
+    pthread_mutex_unlock(&w->inbox_mutex);
+    
+    // Reverse the list so the first submitted job is pushed last
+    ThreadPool_job_t* reversed = NULL;
+    while (list != NULL) {
+        ThreadPool_job_t* next = list->next;
+        list->next = reversed;
+        reversed = list;
+        list = next;
+    }
+    while (reversed != NULL) {
+        ThreadPool_job_t* next = reversed->next;
+        deque_push(&w->deque, reversed);
+        reversed = next;
+    }
+}
+
+/**
+ * ws_find_job - Find the next job for a worker
+ * 
+ * Order: own deque, own inbox, then random victims (deque top, then inbox).
+ * Pinned pools with known nodes sweep the victims on the worker's own
+ * node first, so jobs placed on a node (ThreadPool_add_job_on) tend to
+ * stay there.
+ * @return: Job to run, or NULL if no job was found anywhere
+ */
+static ThreadPool_job_t* ws_find_job(ThreadPool_work* pool, ThreadPool_worker* self) {
+    ThreadPool_job_t* job = deque_take(&self->deque);
+    if (job != NULL) {
+        return job;
+    }
+    
+    drain_inbox(self);
+    job = deque_take(&self->deque);
+    if (job != NULL) {
+        return job;
+    }
+    
+    // Steal: start at a random victim and sweep all other workers once;
+    // with a known node, same-node victims in a first pass, the rest in a second
+    self->rng ^= self->rng << 13;
+    self->rng ^= self->rng >> 17;
+    self->rng ^= self->rng << 5;
+    unsigned int start = self->rng % pool->num_threads;
+    int self_node = (pool->worker_node != NULL) ? pool->worker_node[self - pool->workers] : -1;
+    unsigned int sweeps = (self_node >= 0) ? 2 * pool->num_threads : pool->num_threads;
+    
+    for (unsigned int k = 0; k < sweeps; k++) {
+        unsigned int v = (start + k) % pool->num_threads;
+        ThreadPool_worker* victim = &pool->workers[v];
+        if (victim == self) {
+            continue;
+        }
+        if (self_node >= 0 && (pool->worker_node[v] == self_node) != (k < pool->num_threads)) {
+            continue;  // Not this pass's victim
+        }
+        
+        int r;
+        while ((r = deque_steal(&victim->deque, &job)) < 0) {
+            // Lost a race with another thread; retry this victim
+        }
+        if (r > 0) {
+            return job;
+        }
+        
+        // Victim may be busy on a long job with more work still in its inbox
+        job = inbox_pop(victim);
+        if (job != NULL) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * ws_add_job - Submit a job under the work-stealing policy
+ * 
+ * - From a worker of this pool: push onto the worker's own deque
+ * - From any other thread: append to a worker inbox (round-robin)
+ * - With worker >= 0 (ThreadPool_add_job_on): append to that worker's inbox
+ * Only takes queue_mutex when some worker is parked.
+ */
+static void ws_add_job(ThreadPool_work* pool, ThreadPool_job_t* job, int worker) {
+    if (current_pool == pool && worker < 0) {
+        deque_push(&current_worker->deque, job);
+    } else {
+        unsigned int target = (worker >= 0) ? (unsigned int)worker % pool->num_threads
+                              : atomic_fetch_add(&pool->next_inbox, 1) % pool->num_threads;
+        ThreadPool_worker* w = &pool->workers[target];
+        pthread_mutex_lock(&w->inbox_mutex);
+        if (w->inbox_tail != NULL) {
+            w->inbox_tail->next = job;
+        } else {
+            w->inbox_head = job;
+        }
+        w->inbox_tail = job;
+        pthread_mutex_unlock(&w->inbox_mutex);
+    }
+    
+    // Publish the job before checking for sleepers (pairs with ws_run)
+    atomic_fetch_add(&pool->queued, 1);
+    if (atomic_load(&pool->sleeping) > 0) {
+        pthread_mutex_lock(&pool->queue_mutex);
+        pthread_cond_signal(&pool->jobs_available);
+        pthread_mutex_unlock(&pool->queue_mutex);
+    }
+}
+
+/**
+ * ws_run - Worker loop under the work-stealing policy
+ * 
+ * Runs jobs while any can be found; parks on jobs_available only after a
+ * full sweep found nothing, a short spin saw no new job, and no job is
+ * queued anywhere in the pool.
+ */
+static void ws_run(ThreadPool_work* pool, unsigned int id) {
+    ThreadPool_worker* self = &pool->workers[id];
+    unsigned long long idle_since = 0;
+    unsigned int spin = SPIN_MIN;
+    current_pool = pool;
+    current_worker = self;
+    
+    while (1) {
+        ThreadPool_job_t* job = ws_find_job(pool, self);
+        if (job != NULL) {
+            atomic_fetch_sub(&pool->queued, 1);
+            run_job(pool, id, job, &idle_since);
+            finish_job(pool);
+            continue;
+        }
+        if (spin_for_work(pool, &spin)) {
+            continue;
+        }
+        
+        // Nothing found: park until a job is queued or shutdown
+        pthread_mutex_lock(&pool->queue_mutex);
+        atomic_fetch_add(&pool->sleeping, 1);
+        while (atomic_load(&pool->queued) == 0 && !pool->shutdown) {
+            pthread_cond_wait(&pool->jobs_available, &pool->queue_mutex);
+        }
+        atomic_fetch_sub(&pool->sleeping, 1);
+        bool exiting = pool->shutdown;
+        pthread_mutex_unlock(&pool->queue_mutex);
+        
+        if (exiting) {
+            current_pool = NULL;
+            current_worker = NULL;
+            return;
+        }
+    }
+}
+
 /**
  * ThreadPool_create - Initialize and create a thread pool
  * 
  * @param num: Number of worker threads to create
+ * @param policy: THREADPOOL_SJF or THREADPOOL_WORK_STEALING
  * @return: Pointer to newly created ThreadPool_t object, NULL on failure
  * 
  * Process:
  * 1. Allocate ThreadPool structure
  * 2. Initialize all synchronization primitives
- * 3. Initialize state variables
+ * 3. Initialize state variables (and per-worker deques if work stealing)
  * 4. Create worker threads
  * 
  * Synchronization: None needed (called before threads start)
  */
-ThreadPool_t* ThreadPool_create(unsigned int num) {
+ThreadPool_t* ThreadPool_create(unsigned int num, ThreadPool_policy_t policy) {
+    return ThreadPool_create_ex(num, policy, false);
+}
+
+/**
+ * ThreadPool_create_ex - ThreadPool_create with optional CPU pinning
+ * 
+ * @param pin: true to bind worker i to the i-th allowed CPU (see
+ *             plan_placement); ignored if the CPU set cannot be read
+ */
+ThreadPool_t* ThreadPool_create_ex(unsigned int num, ThreadPool_policy_t policy, bool pin) {
     // Allocate and zero-initialize the thread pool structure
     ThreadPool_work* tp = (ThreadPool_work*)calloc(1, sizeof(ThreadPool_work));
     if (tp == NULL) {
@@ -64,28 +660,54 @@ ThreadPool_t* ThreadPool_create(unsigned int num) {
     // jobs_available: condition variable to wake threads when jobs are added
     pthread_cond_init(&tp->jobs_available, NULL);
     
-    // jobs_done: condition variable to signal when all work is complete
-    // (used by ThreadPool_check as a barrier)
-    pthread_cond_init(&tp->jobs_done, NULL);
-    
-    // Initialize state variables
+    // Initialize state variables (ThreadPool_check waits on outstanding
+    // through done_seq, see finish_job)
     tp->num_threads = num;
-    tp->active_threads = 0;
-    tp->pending_jobs = 0;
+    atomic_init(&tp->active_threads, 0);
+    atomic_init(&tp->pending_jobs, 0);
+    atomic_init(&tp->outstanding, 0);
+    atomic_init(&tp->sleeping, 0);
+    atomic_init(&tp->done_seq, 0);
+    atomic_init(&tp->check_waiters, 0);
     tp->shutdown = false;
+    tp->policy = policy;
+    
+    // Spinning only helps if the submitter can run at the same time
+    cpu_set_t allowed;
+    int cpus = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) ? CPU_COUNT(&allowed) : 1;
+    tp->spin_max = (cpus > 1) ? SPIN_MAX : 0;
     
     // Initialize job queue
     tp->jobs.head = NULL;
     tp->jobs.size = 0;
     
+    // Work stealing: one deque and inbox per worker
+    if (policy == THREADPOOL_WORK_STEALING) {
+        tp->workers = (ThreadPool_worker*)calloc(num, sizeof(ThreadPool_worker));
+        for (unsigned int i = 0; i < num; i++) {
+            deque_init(&tp->workers[i].deque);
+            pthread_mutex_init(&tp->workers[i].inbox_mutex, NULL);
+            tp->workers[i].rng = (2463534242u + i * 2654435761u) | 1;  // Nonzero seed
+        }
+    }
+    atomic_init(&tp->next_worker_id, 0);
+    atomic_init(&tp->next_inbox, 0);
+    atomic_init(&tp->queued, 0);
+    
+    // Statistics stay off until ThreadPool_set_stats
+    atomic_init(&tp->stats_enabled, 0);
+    tp->stats = (ThreadPool_thread_stats_t*)calloc(num, sizeof(ThreadPool_thread_stats_t));
+    
+    // Placement is fixed before any worker starts (workers pin themselves)
+    if (pin && num > 0) {
+        plan_placement(tp);
+    }
+    
     // Allocate array for thread handles
     tp->threads = (pthread_t*)malloc(num * sizeof(pthread_t));
-    if (tp->threads == NULL) {
+    if (tp->threads == NULL || tp->stats == NULL) {
         // Cleanup on allocation failure
-        pthread_mutex_destroy(&tp->queue_mutex);
-        pthread_cond_destroy(&tp->jobs_available);
-        pthread_cond_destroy(&tp->jobs_done);
-        free(tp);
+        ThreadPool_destroy((ThreadPool_t*)tp);
         return NULL;
     }
     
@@ -94,19 +716,12 @@ ThreadPool_t* ThreadPool_create(unsigned int num) {
     for (unsigned int i = 0; i < num; i++) {
         if (pthread_create(&tp->threads[i], NULL, 
                           (void* (*)(void*))Thread_run, tp) != 0) {
-            // If thread creation fails, set shutdown and clean up
-            tp->shutdown = true;
-            // Join any threads that were created
-            for (unsigned int j = 0; j < i; j++) {
-                pthread_join(tp->threads[j], NULL);
-            }
-            pthread_mutex_destroy(&tp->queue_mutex);
-            pthread_cond_destroy(&tp->jobs_available);
-            pthread_cond_destroy(&tp->jobs_done);
-            free(tp->threads);
-            free(tp);
+            // If thread creation fails, shut down and join the threads
+            // that were created
+            ThreadPool_destroy((ThreadPool_t*)tp);
             return NULL;
         }
+        tp->num_started++;
     }
     
     return (ThreadPool_t*)tp;
@@ -126,13 +741,31 @@ ThreadPool_t* ThreadPool_create(unsigned int num) {
  * - Maintained in ascending order by job_size
  * - Smallest jobs at the head (dequeued first)
  * 
+ * Work stealing: delegated to ws_add_job (job_size is only a hint via
+ * submission order)
+ * 
  * Synchronization:
  * - Acquires queue_mutex before modifying queue
- * - Signals jobs_available to wake one waiting thread
+ * - Signals jobs_available to wake one parked thread (none if all idle
+ *   workers are still spinning; they see pending_jobs change)
  * - Releases queue_mutex after insertion
  */
 bool ThreadPool_add_job(ThreadPool_t* tp, thread_func_t func, 
                        void* arg, unsigned long job_size) {
+    return ThreadPool_add_job_on(tp, func, arg, job_size, -1);
+}
+
+/**
+ * ThreadPool_add_job_on - ThreadPool_add_job with a preferred worker
+ * 
+ * @param worker: Worker id that should run the job, -1 for none
+ * 
+ * Work stealing: the job goes to that worker's inbox (others may still
+ * steal it, same-node workers first). SJF has one shared queue and keeps
+ * strict size order, so the hint is ignored.
+ */
+bool ThreadPool_add_job_on(ThreadPool_t* tp, thread_func_t func,
+                           void* arg, unsigned long job_size, int worker) {
     ThreadPool_work* pool = (ThreadPool_work*)tp;
     
     // Allocate new job node
@@ -146,6 +779,16 @@ bool ThreadPool_add_job(ThreadPool_t* tp, thread_func_t func,
     new_job->arg = arg;
     new_job->job_size = job_size;
     new_job->next = NULL;
+    new_job->submit_ns = atomic_load_explicit(&pool->stats_enabled, memory_order_relaxed)
+                         ? now_ns() : 0;
+    
+    // Counted before the job becomes visible, so it cannot finish first
+    atomic_fetch_add(&pool->outstanding, 1);
+    
+    if (pool->policy == THREADPOOL_WORK_STEALING) {
+        ws_add_job(pool, new_job, worker);
+        return true;
+    }
     
     // CRITICAL SECTION: Modify job queue
     pthread_mutex_lock(&pool->queue_mutex);
@@ -169,11 +812,13 @@ bool ThreadPool_add_job(ThreadPool_t* tp, thread_func_t func,
     
     // Update queue statistics
     pool->jobs.size++;
-    pool->pending_jobs++;
+    atomic_fetch_add(&pool->pending_jobs, 1);
     
-    // Wake up ONE waiting thread to process this job
+    // Wake up ONE parked thread to process this job
     // Using signal (not broadcast) for efficiency
-    pthread_cond_signal(&pool->jobs_available);
+    if (atomic_load_explicit(&pool->sleeping, memory_order_relaxed) > 0) {
+        pthread_cond_signal(&pool->jobs_available);
+    }
     
     pthread_mutex_unlock(&pool->queue_mutex);
     // END CRITICAL SECTION
@@ -208,7 +853,7 @@ ThreadPool_job_t* ThreadPool_get_job(ThreadPool_t* tp) {
     ThreadPool_job_t* job = pool->jobs.head;
     pool->jobs.head = job->next;
     pool->jobs.size--;
-    pool->pending_jobs--;
+    atomic_fetch_sub(&pool->pending_jobs, 1);
     
     return job;
 }
@@ -220,25 +865,39 @@ ThreadPool_job_t* ThreadPool_get_job(ThreadPool_t* tp) {
  * @return: NULL (required by pthread_create)
  * 
  * Worker Thread State Machine:
- * 1. Wait for jobs or shutdown signal
+ * 1. Wait for jobs or shutdown signal (spin briefly, then park)
  * 2. Get job from queue (if available)
  * 3. Execute job
  * 4. Signal completion (if all work done)
  * 5. Repeat
  * 
  * Synchronization:
+ * - Spins on pending_jobs (no lock) before parking
  * - Uses pthread_cond_wait for efficient sleeping
  * - Rechecks conditions after waking (spurious wakeups)
  * - Updates active_threads atomically
- * - Signals jobs_done when work complete
+ * - Completion goes through finish_job (no lock)
  * 
  * Correctness:
- * - No race conditions: all shared state accessed under mutex
+ * - No race conditions: the queue is only accessed under mutex
  * - No deadlocks: mutex always released, no circular waits
- * - No missed signals: condition checked in while loop
+ * - No missed signals: condition checked in while loop, and sleeping
+ *   is counted under the mutex the submitter holds when it checks it
  */
 void* Thread_run(ThreadPool_t* tp) {
     ThreadPool_work* pool = (ThreadPool_work*)tp;
+    unsigned int id = atomic_fetch_add(&pool->next_worker_id, 1);
+    unsigned long long idle_since = 0;  // End of the previous job (stats)
+    unsigned int spin = SPIN_MIN;       // Adaptive spin budget (spin_for_work)
+    
+    if (pool->worker_cpu != NULL) {
+        pin_self(pool, id);
+    }
+    
+    if (pool->policy == THREADPOOL_WORK_STEALING) {
+        ws_run(pool, id);
+        return NULL;
+    }
     
     while (1) {
         // CRITICAL SECTION: Check queue state
@@ -250,11 +909,21 @@ void* Thread_run(ThreadPool_t* tp) {
             pthread_exit(NULL);
         }
         
+        // Queue empty: spin outside the lock first, the next job of a
+        // burst usually arrives before a park/wakeup would complete
+        if (pool->jobs.head == NULL && pool->spin_max > 0) {
+            pthread_mutex_unlock(&pool->queue_mutex);
+            spin_for_work(pool, &spin);
+            pthread_mutex_lock(&pool->queue_mutex);
+        }
+        
         // Wait for jobs if queue is empty
         // pthread_cond_wait atomically releases mutex and sleeps
         // It reacquires mutex before returning
         while (pool->jobs.head == NULL && !pool->shutdown) {
+            atomic_fetch_add(&pool->sleeping, 1);
             pthread_cond_wait(&pool->jobs_available, &pool->queue_mutex);
+            atomic_fetch_sub(&pool->sleeping, 1);
         }
         
         // Recheck shutdown after waking (could be shutdown signal)
@@ -267,30 +936,20 @@ void* Thread_run(ThreadPool_t* tp) {
         ThreadPool_job_t* job = ThreadPool_get_job(tp);
         
         // Mark this thread as active
-        pool->active_threads++;
+        atomic_fetch_add(&pool->active_threads, 1);
         
         pthread_mutex_unlock(&pool->queue_mutex);
         // END CRITICAL SECTION
         
         // Execute job OUTSIDE critical section (allows other threads to work)
         if (job != NULL) {
-            job->func(job->arg);
-            free(job);  // Free job node after execution
+            run_job(pool, id, job, &idle_since);  // Frees the job node
         }
         
-        // CRITICAL SECTION: Update completion state
-        pthread_mutex_lock(&pool->queue_mutex);
-        
-        // Mark this thread as idle
-        pool->active_threads--;
-        
-        // If all work is done, signal the barrier (ThreadPool_check)
-        if (pool->active_threads == 0 && pool->pending_jobs == 0) {
-            pthread_cond_signal(&pool->jobs_done);
-        }
-        
-        pthread_mutex_unlock(&pool->queue_mutex);
-        // END CRITICAL SECTION
+        // Mark this thread as idle; if all work is done, release the
+        // barrier (ThreadPool_check)
+        atomic_fetch_sub(&pool->active_threads, 1);
+        finish_job(pool);
     }
     
     return NULL;
@@ -307,28 +966,39 @@ void* Thread_run(ThreadPool_t* tp) {
  * - Used to separate Map and Reduce phases
  * 
  * Synchronization:
- * - Waits on jobs_done condition variable
- * - Worker threads signal when work complete
+ * - outstanding counts queued plus running jobs (both policies)
+ * - Spins briefly, then sleeps on done_seq with a futex (an eventcount:
+ *   read the sequence, recheck, sleep only if it is unchanged)
  * - Handles spurious wakeups with while loop
  * 
  * Correctness:
- * - No deadlock: pthread_cond_wait releases mutex while waiting
- * - No missed signals: condition checked in while loop
- * - Barrier semantics: guaranteed all work done before return
+ * - No lock: workers never take queue_mutex to report completion
+ * - No missed wakeups: see finish_job
+ * - Barrier semantics: guaranteed all work done before return (the
+ *   seq_cst load of outstanding orders the jobs' writes before it)
  */
 void ThreadPool_check(ThreadPool_t* tp) {
     ThreadPool_work* pool = (ThreadPool_work*)tp;
     
-    pthread_mutex_lock(&pool->queue_mutex);
+    for (unsigned int i = 0; i < pool->spin_max; i++) {
+        if (atomic_load(&pool->outstanding) == 0) {
+            return;
+        }
+        cpu_relax();
+    }
+    
+    atomic_fetch_add(&pool->check_waiters, 1);
     
     // Wait until no pending jobs AND no active threads
-    while (pool->pending_jobs > 0 || pool->active_threads > 0) {
-        // pthread_cond_wait releases mutex and sleeps
-        // Reacquires mutex when signaled
-        pthread_cond_wait(&pool->jobs_done, &pool->queue_mutex);
+    while (1) {
+        unsigned int seq = atomic_load(&pool->done_seq);
+        if (atomic_load(&pool->outstanding) == 0) {
+            break;
+        }
+        futex_wait(&pool->done_seq, seq);
     }
     
-    pthread_mutex_unlock(&pool->queue_mutex);
+    atomic_fetch_sub(&pool->check_waiters, 1);
 }
 
 /**
@@ -366,14 +1036,13 @@ void ThreadPool_destroy(ThreadPool_t* tp) {
     // END CRITICAL SECTION
     
     // Wait for all threads to exit cleanly
-    for (unsigned int i = 0; i < pool->num_threads; i++) {
+    for (unsigned int i = 0; i < pool->num_started; i++) {
         pthread_join(pool->threads[i], NULL);
     }
     
     // Clean up synchronization primitives
     pthread_mutex_destroy(&pool->queue_mutex);
     pthread_cond_destroy(&pool->jobs_available);
-    pthread_cond_destroy(&pool->jobs_done);
     
     // Free any remaining jobs in queue (shouldn't be any if used correctly)
     ThreadPool_job_t* current = pool->jobs.head;
@@ -383,9 +1052,88 @@ void ThreadPool_destroy(ThreadPool_t* tp) {
         current = next;
     }
     
-    // Free thread handle array
+    // Work stealing: release deques and leftover inbox jobs
+    if (pool->workers != NULL) {
+        for (unsigned int i = 0; i < pool->num_threads; i++) {
+            ThreadPool_job_t* job;
+            while ((job = deque_take(&pool->workers[i].deque)) != NULL) {
+                free(job);
+            }
+            while ((job = inbox_pop(&pool->workers[i])) != NULL) {
+                free(job);
+            }
+            deque_free(&pool->workers[i].deque);
+            pthread_mutex_destroy(&pool->workers[i].inbox_mutex);
+        }
+        free(pool->workers);
+    }
+    
+    // Free thread handle array and statistics
     free(pool->threads);
+    free(pool->stats);
+    free(pool->worker_cpu);
+    free(pool->worker_node);
     
     // Free thread pool structure
     free(pool);
-}
\ No newline at end of file
+}
+
+/**
+ * ThreadPool_set_stats - Start or stop collecting per-thread statistics
+ * 
+ * @param tp: Pointer to the ThreadPool object
+ * @param enabled: true to start (counters reset), false to stop
+ * 
+ * Idle time is counted from the start. Jobs submitted before it carry no
+ * submission time and add nothing to the queue latency. Must be called
+ * while no job runs (e.g. after ThreadPool_check), since it writes the
+ * counters the workers own.
+ */
+void ThreadPool_set_stats(ThreadPool_t* tp, bool enabled) {
+    ThreadPool_work* pool = (ThreadPool_work*)tp;
+    
+    if (!enabled) {
+        atomic_store_explicit(&pool->stats_enabled, 0, memory_order_release);
+        return;
+    }
+    memset(pool->stats, 0, pool->num_threads * sizeof(ThreadPool_thread_stats_t));
+    pool->stats_start = now_ns();
+    atomic_store_explicit(&pool->stats_enabled, 1, memory_order_release);
+}
+
+/**
+ * ThreadPool_get_stats - Copy the per-thread statistics
+ * 
+ * @param tp: Pointer to the ThreadPool object
+ * @param stats: Receives min(max, threads) entries
+ * @param max: Entries available in stats
+ * @return: Number of threads in the pool
+ * 
+ * Synchronization: workers update their entry before a job counts as
+ * finished, so after ThreadPool_check the copy is consistent. Idle time
+ * of a currently parked worker is not included until its next job.
+ */
+unsigned int ThreadPool_get_stats(ThreadPool_t* tp, ThreadPool_thread_stats_t* stats,
+                                  unsigned int max) {
+    ThreadPool_work* pool = (ThreadPool_work*)tp;
+    unsigned int n = (max < pool->num_threads) ? max : pool->num_threads;
+    
+    memcpy(stats, pool->stats, n * sizeof(ThreadPool_thread_stats_t));
+    return pool->num_threads;
+}
+
+/**
+ * ThreadPool_worker_node - NUMA node a worker is pinned on
+ * 
+ * @param tp: Pointer to the ThreadPool object
+ * @param worker: Worker id (taken modulo the pool size)
+ * @return: Node number, -1 if the pool is not pinned or the node is unknown
+ */
+int ThreadPool_worker_node(ThreadPool_t* tp, unsigned int worker) {
+    ThreadPool_work* pool = (ThreadPool_work*)tp;
+    
+    if (pool->worker_node == NULL || pool->num_threads == 0) {
+        return -1;
+    }
+    return pool->worker_node[worker % pool->num_threads];
+}
@@ -7,11 +7,18 @@
 
 typedef void (*thread_func_t)(void* arg);
 
+// Scheduling policy, chosen when the pool is created
+typedef enum {
+    THREADPOOL_SJF,            // One shared queue ordered by job_size
+    THREADPOOL_WORK_STEALING   // Per-worker deques, idle workers steal
+} ThreadPool_policy_t;
+
 typedef struct ThreadPool_job_t {
     thread_func_t func;             // function pointer
     void* arg;                      // arguments for that function
     struct ThreadPool_job_t* next;  // pointer to the next job in the queue
     unsigned long job_size;         // size metric for SJF scheduling
+    unsigned long long submit_ns;   // submission time, 0 unless stats are on
     // add other members if needed
 } ThreadPool_job_t;
 
@@ -21,6 +28,15 @@ typedef struct {
     // add other members if needed
 } ThreadPool_job_queue_t;
 
+// Per-thread counters, collected after ThreadPool_set_stats
+typedef struct {
+    unsigned long jobs;                   // jobs run by this thread
+    unsigned long long busy_ns;           // time spent inside job functions
+    unsigned long long idle_ns;           // time between jobs (searching or parked)
+    unsigned long long queue_wait_ns;     // sum of submit-to-start latency of its jobs
+    unsigned long long queue_wait_max_ns; // longest submit-to-start latency
+} ThreadPool_thread_stats_t;
+
 typedef struct {
     pthread_t* threads;           // pointer to the array of thread handles
     ThreadPool_job_queue_t jobs;  // queue of jobs waiting for a thread to run
@@ -31,11 +47,23 @@ typedef struct {
 /**
 * C style constructor for creating a new ThreadPool object
 * Parameters:
-*     num - Number of threads to create
+*     num    - Number of threads to create
+*     policy - THREADPOOL_SJF or THREADPOOL_WORK_STEALING
 * Return:
 *     ThreadPool_t* - Pointer to the newly created ThreadPool object
 */
-ThreadPool_t* ThreadPool_create(unsigned int num);
+ThreadPool_t* ThreadPool_create(unsigned int num, ThreadPool_policy_t policy);
+
+/**
+* ThreadPool_create with optional CPU pinning
+* Parameters:
+*     num    - Number of threads to create
+*     policy - THREADPOOL_SJF or THREADPOOL_WORK_STEALING
+*     pin    - true to pin worker i to the i-th CPU the process may use
+* Return:
+*     ThreadPool_t* - Pointer to the newly created ThreadPool object
+*/
+ThreadPool_t* ThreadPool_create_ex(unsigned int num, ThreadPool_policy_t policy, bool pin);
 
 /**
 * C style destructor to destroy a ThreadPool object
@@ -57,7 +85,31 @@ void ThreadPool_destroy(ThreadPool_t* tp);
 bool ThreadPool_add_job(ThreadPool_t* tp, thread_func_t func, void* arg, unsigned long job_size);
 
 /**
-* Get a job from the job queue of the ThreadPool object
+* Add a job that should run on a given worker (work stealing only; other
+* workers may still steal it, same NUMA node first)
+* Parameters:
+*     tp .. job_size - Same as ThreadPool_add_job
+*     worker         - Preferred worker id, -1 for none
+* Return:
+*     true  - On success
+*     false - Otherwise
+*/
+bool ThreadPool_add_job_on(ThreadPool_t* tp, thread_func_t func, void* arg,
+                           unsigned long job_size, int worker);
+
+/**
+* Get the NUMA node of a pinned worker
+* Parameters:
+*     tp     - Pointer to the ThreadPool object
+*     worker - Worker id
+* Return:
+*     int - Node number, -1 if not pinned or unknown
+*/
+int ThreadPool_worker_node(ThreadPool_t* tp, unsigned int worker);
+
+/**
+* Get a job from the job queue of the ThreadPool object (SJF policy;
+* caller holds the queue lock)
 * Parameters:
 *     tp - Pointer to the ThreadPool object
 * Return:
@@ -80,4 +132,26 @@ void* Thread_run(ThreadPool_t* tp);
 */
 void ThreadPool_check(ThreadPool_t *tp);
 
+/**
+* Start (with counters reset) or stop collecting per-thread statistics;
+* call while the pool is idle
+* Parameters:
+*     tp      - Pointer to the ThreadPool object
+*     enabled - true to collect
+*/
+void ThreadPool_set_stats(ThreadPool_t* tp, bool enabled);
+
+/**
+* Copy the per-thread statistics; call while the pool is idle (after
+* ThreadPool_check)
+* Parameters:
+*     tp    - Pointer to the ThreadPool object
+*     stats - Array receiving one entry per thread
+*     max   - Entries available in stats
+* Return:
+*     unsigned int - Number of threads in the pool
+*/
+unsigned int ThreadPool_get_stats(ThreadPool_t* tp, ThreadPool_thread_stats_t* stats,
+                                  unsigned int max);
+
 #endif
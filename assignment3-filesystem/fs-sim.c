@@ -10,19 +10,429 @@
 #include <string.h>
 #include <strings.h>  // For strcasecmp
 #include <stdint.h>
+#include <limits.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "fs-sim.h"
 
+// Version 0 (original) disk geometry
+#define V0_NUM_BLOCKS 128
+#define V0_BLOCK_SIZE 1024
+#define V0_NUM_INODES 126
+
+#define BUFFER_BLOCKS 127  // Largest v0 file, so R/W can move a whole one at once
+
+/**
+ * Geometry of a disk and where its metadata lives in the disk image.
+ * Version 0 disks get the fixed original values.
+ */
+typedef struct {
+    int version;         // 0 = original 128 KB format, 1 = DiskHeader
+    int block_size;      // Bytes per block
+    int num_blocks;      // Blocks on the disk, metadata included
+    int num_inodes;      // Inode slots (num_inodes is reserved, num_inodes + 1 is root)
+    int first_data;      // First block after the metadata (v0: just the superblock)
+    int journal_start;   // First journal block (v1 only)
+    int journal_blocks;  // Journal blocks, 0 = no journal (always for v0)
+    uint8_t *free_list;  // Free-space list in the image
+    uint8_t *inodes;     // Inode table in the image (Inode or InodeV1 records)
+} Volume;
+
 //Global variables
-static Superblock sb;
-static uint8_t buffer[1024];
+static Volume vol;             // Geometry of the mounted disk
+static uint8_t *buffer;        // BUFFER_BLOCKS blocks; block 0 is the buffer of R/W/B
+static size_t buffer_size = 0; // Bytes allocated for buffer
 static int current_dir_inode = 127; 
 static int disk_fd = -1;
 static int is_mounted = 0;
 static char current_disk_name[256];
 
+/**
+ * Allocates zeroed memory, exiting if there is none
+ */
+static void *xcalloc(size_t count, size_t size) {
+    void *p = calloc(count ? count : 1, size);
+    if (!p) {
+        perror("calloc");
+        exit(1);
+    }
+    return p;
+}
+
+/* ========================================================================
+ * BLOCK CACHE
+ * The mounted disk's image is kept in memory. By default the image lives in
+ * a cache: the metadata blocks are read at mount and data blocks on first
+ * use, and changes are written back only when the cache is flushed (before
+ * mounting a disk, on exit, and on the S command).
+ * With FS_SIM_MMAP=1 the disk file is mmap'd instead, so block access is a
+ * plain memcpy into the page cache and the S command becomes an msync.
+ * ======================================================================== */
+
+#define CACHE_READAHEAD 32  // Uncached blocks loaded together on a miss
+
+/**
+ * In-memory image of a disk
+ */
+typedef struct {
+    uint8_t *data;    // malloc'd cache, or the mapped disk file
+    size_t size;      // num_blocks * block_size
+    int mapped;       // data is a mapping
+    uint64_t *valid;  // Bit set = block loaded
+    uint64_t *dirty;  // Bit set = not yet on disk
+    uint64_t *zero;   // Bit set = block known to be all zeros in the image
+    int disk_blocks;  // Whole blocks in the disk file (past them reads as zeros)
+} Image;
+
+static Image img;         // Image of the mounted disk
+static int use_mmap = 0;  // FS_SIM_MMAP set
+
+static inline int bit_test(const uint64_t *map, int n) {
+    return (map[n / 64] >> (n % 64)) & 1;
+}
+
+static inline void bit_set(uint64_t *map, int n) {
+    map[n / 64] |= 1ULL << (n % 64);
+}
+
+static inline void bit_clear(uint64_t *map, int n) {
+    map[n / 64] &= ~(1ULL << (n % 64));
+}
+
+/**
+ * Finds the first bit at or after from that is set (want = 1) or clear
+ * (want = 0), skipping whole 64-bit words at a time.
+ * return: Bit index, or limit if there is none before limit
+ */
+static int next_bit(const uint64_t *map, int from, int limit, int want) {
+    while (from < limit) {
+        uint64_t word = want ? map[from / 64] : ~map[from / 64];
+        word >>= from % 64;
+        if (word) {
+            from += __builtin_ctzll(word);
+            return from < limit ? from : limit;
+        }
+        from = (from / 64 + 1) * 64;
+    }
+    return limit;
+}
+
+/**
+ * Maps a disk file for FS_SIM_MMAP mode.
+ * return: The mapping, or NULL to use the cache (mode off, or the file is
+ *         too short to map without faulting past its end)
+ */
+static uint8_t *map_disk(int fd, size_t size, off_t file_size) {
+    if (!use_mmap || file_size < (off_t)size) {
+        return NULL;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return map == MAP_FAILED ? NULL : map;
+}
+
+/**
+ * Frees (or unmaps) an image
+ */
+static void close_image(Image *image) {
+    if (image->mapped) {
+        munmap(image->data, image->size);
+    } else {
+        free(image->data);
+    }
+    free(image->valid);
+    free(image->dirty);
+    free(image->zero);
+    memset(image, 0, sizeof(*image));
+}
+
+/**
+ * Sets up the image of a disk being mounted. A mapped disk is entirely
+ * "loaded"; otherwise its metadata blocks are read now, with one pread.
+ * return: 0, or -1 if the metadata cannot be read
+ */
+static int open_image(int fd, const Volume *v, Image *image) {
+    size_t words = ((size_t)v->num_blocks + 63) / 64;
+    image->size = (size_t)v->num_blocks * v->block_size;
+    image->valid = xcalloc(words, sizeof(uint64_t));
+    image->dirty = xcalloc(words, sizeof(uint64_t));
+    image->zero = xcalloc(words, sizeof(uint64_t));
+
+    struct stat st;
+    off_t file_size = fstat(fd, &st) == 0 ? st.st_size : 0;
+    image->disk_blocks = file_size / v->block_size < v->num_blocks
+                         ? (int)(file_size / v->block_size) : v->num_blocks;
+
+    // A journal needs metadata held back until committed, so never map one
+    image->data = v->journal_blocks ? NULL : map_disk(fd, image->size, file_size);
+    if (image->data) {
+        image->mapped = 1;
+        memset(image->valid, 0xFF, words * sizeof(uint64_t));
+        return 0;
+    }
+
+    image->data = malloc(image->size);  // Blocks are filled before first use
+    size_t meta = (size_t)v->first_data * v->block_size;
+    if (!image->data || pread(fd, image->data, meta, 0) != (ssize_t)meta) {
+        close_image(image);
+        return -1;
+    }
+    for (int b = 0; b < v->first_data; b++) {
+        bit_set(image->valid, b);
+    }
+    return 0;
+}
+
+/**
+ * Releases the mounted disk's image and closes it
+ */
+static void release_disk(void) {
+    close_image(&img);
+    close(disk_fd);
+    disk_fd = -1;
+}
+
+/**
+ * Loads block_num and the uncached blocks that follow it from disk with a
+ * single pread, stopping at the first cached block. At least up to min_end
+ * is loaded (if uncached), or up to CACHE_READAHEAD blocks when that is more.
+ */
+static void cache_fill(int block_num, int min_end) {
+    int limit = block_num + CACHE_READAHEAD;
+    if (limit < min_end) limit = min_end;
+    if (limit > vol.num_blocks) limit = vol.num_blocks;
+    int end = next_bit(img.valid, block_num, limit, 1);
+
+    uint8_t *data = img.data + (size_t)block_num * vol.block_size;
+    size_t len = (size_t)(end - block_num) * vol.block_size;
+    ssize_t n = pread(disk_fd, data, len, (off_t)block_num * vol.block_size);
+    if (n < 0) n = 0;
+    // Past the end of a short disk image reads as zeros
+    memset(data + n, 0, len - n);
+
+    for (int b = block_num; b < end; b++) {
+        bit_set(img.valid, b);
+    }
+}
+
+/**
+ * Writes every run of dirty blocks in [from, to) back to disk, one pwrite
+ * per run of consecutive blocks (an msync per run for a mapped disk).
+ */
+static void write_dirty(int from, int to) {
+    long page = sysconf(_SC_PAGESIZE);
+    int start = next_bit(img.dirty, from, to, 1);
+    while (start < to) {
+        int end = next_bit(img.dirty, start, to, 0);
+        size_t off = (size_t)start * vol.block_size;
+        size_t len = (size_t)(end - start) * vol.block_size;
+
+        if (img.mapped) {
+            // msync wants a page-aligned start
+            size_t skew = off % page;
+            if (msync(img.data + off - skew, len + skew, MS_SYNC) < 0) {
+                perror("msync");
+            }
+        } else if (pwrite(disk_fd, img.data + off, len, off) != (ssize_t)len) {
+            perror("pwrite");
+        }
+        for (int b = start; b < end; b++) {
+            bit_clear(img.dirty, b);
+        }
+        start = next_bit(img.dirty, end, to, 1);
+    }
+}
+
+/* ------------------------------------------------------------------------
+ * Metadata journal (v1 disks with a journal region). Changed bitmap and
+ * inode blocks reach their home blocks only after copies of them have been
+ * logged to the journal and made durable, so a crash leaves either the old
+ * or the new metadata, never a mix. Everything changed since the last flush
+ * goes into one commit (group commit): a single sequential write of the
+ * journal header and block copies, one fsync, then the checkpoint (the
+ * blocks written home) and a second fsync before the journal is cleared.
+ * Data blocks are written and fdatasync'd before the commit, so committed
+ * metadata never points at blocks that have not reached the disk yet.
+ * ------------------------------------------------------------------------ */
+
+static uint32_t journal_seq = 0;  // Last commit on the mounted disk
+
+static uint32_t fnv1a(uint32_t h, const void *data, size_t len) {
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+/**
+ * Checksum of a commit: sequence, count, targets, then the copies
+ */
+static uint32_t journal_checksum(const JournalHeader *jh, const uint8_t *copies, int block_size) {
+    uint32_t h = fnv1a(2166136261u, &jh->sequence, 2 * sizeof(uint32_t));
+    h = fnv1a(h, jh->target, (size_t)jh->count * sizeof(uint32_t));
+    return fnv1a(h, copies, (size_t)jh->count * block_size);
+}
+
+/**
+ * Most blocks one commit can log: limited by the journal region and by
+ * the targets that fit in the header block
+ */
+static int journal_capacity(const Volume *v) {
+    int by_header = (v->block_size - (int)sizeof(JournalHeader)) / (int)sizeof(uint32_t);
+    int by_region = v->journal_blocks - 1;
+    return by_header < by_region ? by_header : by_region;
+}
+
+/**
+ * Writes a journal header with nothing to replay
+ */
+static void journal_clear(int fd, const Volume *v, uint32_t sequence) {
+    JournalHeader *jh = xcalloc(1, v->block_size);
+    memcpy(jh->magic, FS_JOURNAL_MAGIC, sizeof(jh->magic));
+    jh->sequence = sequence;
+    if (pwrite(fd, jh, v->block_size, (off_t)v->journal_start * v->block_size) != v->block_size) {
+        perror("pwrite");
+    }
+    free(jh);
+}
+
+/**
+ * Logs every dirty metadata block of the mounted disk and makes the log
+ * durable (the commit point).
+ * return: 1, or 0 if they do not fit in the journal or the log could not
+ *         be written (then nothing is committed and the caller writes
+ *         them home directly)
+ */
+static int journal_commit(void) {
+    int bs = vol.block_size;
+    int count = 0;
+    for (int b = next_bit(img.dirty, 0, vol.journal_start, 1); b < vol.journal_start;
+         b = next_bit(img.dirty, b + 1, vol.journal_start, 1)) {
+        count++;
+    }
+    if (count > journal_capacity(&vol)) return 0;
+
+    // Header block followed by the copies, exactly as they go on disk
+    uint8_t *log = xcalloc((size_t)count + 1, bs);
+    JournalHeader *jh = (JournalHeader *)log;
+    int k = 0;
+    for (int b = next_bit(img.dirty, 0, vol.journal_start, 1); b < vol.journal_start;
+         b = next_bit(img.dirty, b + 1, vol.journal_start, 1)) {
+        jh->target[k] = b;
+        memcpy(log + (size_t)(k + 1) * bs, img.data + (size_t)b * bs, bs);
+        k++;
+    }
+    memcpy(jh->magic, FS_JOURNAL_MAGIC, sizeof(jh->magic));
+    jh->sequence = ++journal_seq;
+    jh->count = count;
+    jh->checksum = journal_checksum(jh, log + bs, bs);
+
+    size_t len = (size_t)(count + 1) * bs;
+    int committed = 1;
+    if (pwrite(disk_fd, log, len, (off_t)vol.journal_start * bs) != (ssize_t)len) {
+        perror("pwrite");
+        committed = 0;
+    } else if (fsync(disk_fd) < 0) {
+        perror("fsync");
+        committed = 0;
+    }
+    free(log);
+    return committed;
+}
+
+/**
+ * Finishes a commit that was interrupted (logged but maybe not written
+ * home), before the disk's metadata is read and checked. A journal that
+ * is empty, torn or garbled is ignored.
+ * return: Sequence of the last commit, so the next one follows it
+ */
+static uint32_t journal_replay(int fd, const Volume *v) {
+    if (v->journal_blocks == 0) return 0;
+
+    int bs = v->block_size;
+    JournalHeader *jh = xcalloc(1, bs);
+    off_t journal_off = (off_t)v->journal_start * bs;
+    if (pread(fd, jh, bs, journal_off) != bs || memcmp(jh->magic, FS_JOURNAL_MAGIC, 8) != 0) {
+        free(jh);
+        return 0;  // Never committed to
+    }
+    uint32_t sequence = jh->sequence;
+    if (jh->count == 0 || jh->count > (uint32_t)journal_capacity(v)) {
+        free(jh);
+        return sequence;
+    }
+
+    size_t len = (size_t)jh->count * bs;
+    uint8_t *copies = xcalloc(jh->count, bs);
+    int valid = pread(fd, copies, len, journal_off + bs) == (ssize_t)len &&
+                journal_checksum(jh, copies, bs) == jh->checksum;
+    // Only bitmap and inode blocks are ever logged
+    for (uint32_t k = 0; valid && k < jh->count; k++) {
+        valid = jh->target[k] >= 1 && jh->target[k] < (uint32_t)v->journal_start;
+    }
+
+    if (valid) {
+        for (uint32_t k = 0; k < jh->count; k++) {
+            if (pwrite(fd, copies + (size_t)k * bs, bs, (off_t)jh->target[k] * bs) != bs) {
+                perror("pwrite");
+            }
+        }
+        fsync(fd);
+        journal_clear(fd, v, sequence);
+    }
+    free(copies);
+    free(jh);
+    return sequence;
+}
+
+/**
+ * Writes every dirty block back to disk. If durable, also waits for them
+ * to reach stable storage. A mapped disk's stores are already in the page
+ * cache, so for it only a durable flush does anything.
+ * On a disk with a journal, changed metadata is committed to the journal
+ * first (see above), so every flush is durable there.
+ */
+static void flush_cache(int durable) {
+    if (!is_mounted || disk_fd < 0) return;
+    if (img.mapped && !durable) return;
+
+    if (vol.journal_blocks > 0 &&
+        next_bit(img.dirty, 0, vol.journal_start, 1) < vol.journal_start) {
+        write_dirty(vol.first_data, vol.num_blocks);  // Data first
+        if (fdatasync(disk_fd) < 0) {
+            perror("fdatasync");
+        }
+        if (journal_commit()) {
+            write_dirty(0, vol.journal_start);         // Checkpoint
+            fsync(disk_fd);
+            journal_clear(disk_fd, &vol, journal_seq);
+            return;
+        }
+        // Too many blocks to log at once, or the log write failed:
+        // written home unlogged below
+    }
+
+    write_dirty(0, vol.num_blocks);
+    if (durable && !img.mapped) {
+        fsync(disk_fd);
+    }
+}
+
+/**
+ * Marks the metadata blocks holding [p, p + len) for write-back.
+ * Called on every change to the free-space list or an inode.
+ */
+static void meta_dirty(const void *p, size_t len) {
+    size_t off = (const uint8_t *)p - img.data;
+    int last = (off + len - 1) / vol.block_size;
+    for (int b = off / vol.block_size; b <= last; b++) {
+        bit_set(img.dirty, b);
+    }
+}
+
 /* ========================================================================
  * BIT MANIPULATION & INODE HELPERS
  * ======================================================================== */
@@ -97,18 +507,128 @@ static inline void set_parent_index(Inode *inode, int parent) {
     inode->isdir_parent = (inode->isdir_parent & 0x80) | (parent & 0x7F);
 }
 
+/* ------------------------------------------------------------------------
+ * Inode access by index, for either format: v0 inodes go through the bit
+ * packing helpers above, v1 inodes (InodeV1) have plain fields. The vol_*
+ * readers take the volume so the consistency check can run on a disk
+ * before it is mounted; the rest work on the mounted disk.
+ * ------------------------------------------------------------------------ */
+
+static inline size_t inode_record_size(const Volume *v) {
+    return v->version ? sizeof(InodeV1) : sizeof(Inode);
+}
+
+static inline Inode *v0_inode(const Volume *v, int i) {
+    return (Inode *)(v->inodes + (size_t)i * sizeof(Inode));
+}
+
+static inline InodeV1 *v1_inode(const Volume *v, int i) {
+    return (InodeV1 *)(v->inodes + (size_t)i * sizeof(InodeV1));
+}
+
+static inline int vol_inode_used(const Volume *v, int i) {
+    return v->version ? (v1_inode(v, i)->flags & 0x80) != 0 : is_inode_used(v0_inode(v, i));
+}
+
+static inline int vol_inode_is_dir(const Volume *v, int i) {
+    return v->version ? (v1_inode(v, i)->flags & 0x40) != 0 : is_directory(v0_inode(v, i));
+}
+
+static inline int64_t vol_inode_size(const Volume *v, int i) {
+    return v->version ? v1_inode(v, i)->size : get_file_size(v0_inode(v, i));
+}
+
+static inline int64_t vol_inode_start(const Volume *v, int i) {
+    return v->version ? v1_inode(v, i)->start_block : v0_inode(v, i)->start_block;
+}
+
+static inline int vol_inode_parent(const Volume *v, int i) {
+    return v->version ? v1_inode(v, i)->parent : get_parent_index(v0_inode(v, i));
+}
+
+/** The 5 name bytes (not null-terminated); at offset 0 in both formats */
+static inline const char *vol_inode_name(const Volume *v, int i) {
+    return v->version ? v1_inode(v, i)->name : v0_inode(v, i)->name;
+}
+
+static inline int root_inode(void) { return vol.num_inodes + 1; }
+static inline int inode_used(int i) { return vol_inode_used(&vol, i); }
+static inline int inode_is_dir(int i) { return vol_inode_is_dir(&vol, i); }
+static inline int inode_size(int i) { return (int)vol_inode_size(&vol, i); }
+static inline int inode_start(int i) { return (int)vol_inode_start(&vol, i); }
+static inline int inode_parent(int i) { return vol_inode_parent(&vol, i); }
+
+/**
+ * Fills in a free inode of the mounted disk (name handles 5 maximum).
+ * size and start are 0 for a directory.
+ */
+static void set_inode(int i, const char *name, int is_dir, int size, int start, int parent) {
+    char padded[5] = {0};  // Names are zero-padded, no terminator
+    memcpy(padded, name, strnlen(name, 5));
+
+    if (vol.version) {
+        InodeV1 *inode = v1_inode(&vol, i);
+        memcpy(inode->name, padded, 5);
+        inode->flags = 0x80 | (is_dir ? 0x40 : 0);
+        inode->parent = parent;
+        inode->start_block = start;
+        inode->size = size;
+        meta_dirty(inode, sizeof(InodeV1));
+    } else {
+        Inode *inode = v0_inode(&vol, i);
+        memset(inode, 0, sizeof(Inode));
+        memcpy(inode->name, padded, 5);
+        set_inode_used(inode, 1);
+        set_parent_index(inode, parent);
+        set_is_directory(inode, is_dir);
+        set_file_size(inode, size);
+        inode->start_block = start;
+        meta_dirty(inode, sizeof(Inode));
+    }
+}
+
+/**
+ * Moves a file of the mounted disk to a new first block
+ */
+static void set_start_block(int i, int start) {
+    if (vol.version) {
+        v1_inode(&vol, i)->start_block = start;
+        meta_dirty(v1_inode(&vol, i), sizeof(InodeV1));
+    } else {
+        v0_inode(&vol, i)->start_block = start;
+        meta_dirty(v0_inode(&vol, i), sizeof(Inode));
+    }
+}
+
+/**
+ * Zeroes an inode of the mounted disk (marks it free)
+ */
+static void clear_inode(int i) {
+    uint8_t *raw = vol.inodes + (size_t)i * inode_record_size(&vol);
+    memset(raw, 0, inode_record_size(&vol));
+    meta_dirty(raw, inode_record_size(&vol));
+}
+
 /* ========================================================================
  * FREE BLOCK LIST HELPERS
- * These functions manage the free-space bitmap in the superblock.
+ * These functions manage the free-space bitmap in the superblock
+ * (its own blocks on v1 disks).
  * ======================================================================== */
 
 /**
- * Checks if a block is marked free in the free-space list.
+ * Checks if a block is marked free in a volume's free-space list.
  */
-static int is_block_free(int block_num) {
+static int is_block_free_in(const Volume *v, int block_num) {
     int byte_idx = block_num / 8; //Finds byte index
     int bit_idx = 7 - (block_num % 8); //Finds bit index within byte (7 is MSB)
-    return (sb.free_block_list[byte_idx] & (1 << bit_idx)) == 0; //Returns 1 if free (bit=0), 0 if used (bit=1)
+    return (v->free_list[byte_idx] & (1 << bit_idx)) == 0; //Returns 1 if free (bit=0), 0 if used (bit=1)
+}
+
+/**
+ * Checks if a block is marked free in the free-space list.
+ */
+static int is_block_free(int block_num) {
+    return is_block_free_in(&vol, block_num);
 }
 
 /**
@@ -119,10 +639,112 @@ static void set_block_free(int block_num, int free) {
     int bit_idx = 7 - (block_num % 8); //Finds bit index within byte (7 is MSB)
     
     if (free) {
-        sb.free_block_list[byte_idx] &= ~(1 << bit_idx);   // Clear bit (free)   
+        vol.free_list[byte_idx] &= ~(1 << bit_idx);   // Clear bit (free)
          } else {
-         sb.free_block_list[byte_idx] |= (1 << bit_idx);  // Set bit (used)
+         vol.free_list[byte_idx] |= (1 << bit_idx);  // Set bit (used)
+    }
+    meta_dirty(&vol.free_list[byte_idx], 1);
+}
+
+/* ------------------------------------------------------------------------
+ * Free-extent index: a segment tree over the blocks. Each node stores the
+ * longest free run in its range, plus the free runs touching its two ends,
+ * so the first run that fits a request is found in O(log n) and a range of
+ * blocks is marked in O(log n). Rebuilt from the free-space list at mount
+ * and after defrag, and kept in sync by mark_blocks_used.
+ * ------------------------------------------------------------------------ */
+
+typedef struct {
+    int pre;   // Free blocks at the start of the range
+    int suf;   // Free blocks at the end of the range
+    int best;  // Longest free run in the range
+} FreeRun;
+
+static int tree_leaves = 0;       // num_blocks rounded up to a power of two
+static FreeRun *run_tree = NULL;  // Node 1 is all blocks; children 2n, 2n+1
+static int8_t *run_fill = NULL;   // Pending assignment: -1 none, 0 used, 1 free
+
+/**
+ * Makes every block in a node's range free or used.
+ */
+static void run_assign(int node, int len, int free) {
+    int n = free ? len : 0;
+    run_tree[node] = (FreeRun){ n, n, n };
+    run_fill[node] = free;
+}
+
+/**
+ * Recomputes a node (covering len blocks) from its two children.
+ */
+static void run_pull(int node, int len) {
+    int half = len / 2;
+    const FreeRun *l = &run_tree[2 * node], *r = &run_tree[2 * node + 1];
+    FreeRun *t = &run_tree[node];
+
+    t->pre = l->pre == half ? half + r->pre : l->pre;
+    t->suf = r->suf == half ? half + l->suf : r->suf;
+    t->best = l->suf + r->pre;
+    if (l->best > t->best) t->best = l->best;
+    if (r->best > t->best) t->best = r->best;
+}
+
+/**
+ * Hands a pending assignment down to a node's children.
+ */
+static void run_push(int node, int len) {
+    if (run_fill[node] >= 0) {
+        run_assign(2 * node, len / 2, run_fill[node]);
+        run_assign(2 * node + 1, len / 2, run_fill[node]);
+        run_fill[node] = -1;
+    }
+}
+
+/**
+ * Marks blocks [start, end) free or used in the subtree of node, which
+ * covers [lo, lo + len).
+ */
+static void run_update(int node, int lo, int len, int start, int end, int free) {
+    if (end <= lo || start >= lo + len) return;
+    if (start <= lo && lo + len <= end) {
+        run_assign(node, len, free);
+        return;
     }
+    run_push(node, len);
+    run_update(2 * node, lo, len / 2, start, end, free);
+    run_update(2 * node + 1, lo + len / 2, len / 2, start, end, free);
+    run_pull(node, len);
+}
+
+/**
+ * Builds the subtree of node, covering [lo, lo + len), from the free-space
+ * list. Leaves past the last block count as used.
+ */
+static void run_build(int node, int lo, int len) {
+    run_fill[node] = -1;
+    if (len == 1) {
+        int n = (lo < vol.num_blocks && is_block_free(lo)) ? 1 : 0;
+        run_tree[node] = (FreeRun){ n, n, n };
+        return;
+    }
+    run_build(2 * node, lo, len / 2);
+    run_build(2 * node + 1, lo + len / 2, len / 2);
+    run_pull(node, len);
+}
+
+/**
+ * Rebuilds the free-extent index from the free-space list
+ */
+static void free_index_build(void) {
+    int leaves = 1;
+    while (leaves < vol.num_blocks) leaves *= 2;
+    if (leaves != tree_leaves) {
+        free(run_tree);
+        free(run_fill);
+        tree_leaves = leaves;
+        run_tree = xcalloc(2 * (size_t)leaves, sizeof(FreeRun));
+        run_fill = xcalloc(2 * (size_t)leaves, sizeof(int8_t));
+    }
+    run_build(1, 0, tree_leaves);
 }
 
 /**
@@ -132,35 +754,51 @@ static void set_block_free(int block_num, int free) {
  * used: 1 to mark used, 0 to mark free
  */
 static void mark_blocks_used(int start, int count, int used) {
-    for (int i = 0; i < count; i++) {
-        set_block_free(start + i, !used);
+    run_update(1, 0, tree_leaves, start, start + count, !used);
+
+    // Bits in partial bytes one at a time, whole bytes in between with memset
+    int end = start + count;
+    while (start < end && start % 8 != 0) {
+        set_block_free(start++, !used);
+    }
+    while (end > start && end % 8 != 0) {
+        set_block_free(--end, !used);
+    }
+    if (end > start) {
+        memset(&vol.free_list[start / 8], used ? 0xFF : 0x00, (end - start) / 8);
+        meta_dirty(&vol.free_list[start / 8], (end - start) / 8);
     }
 }
 
 /**
- * Finds the first contiguous sequence of free blocks.
+ * Finds the first contiguous sequence of free blocks (first fit, so files
+ * land exactly where a linear scan from the first data block would put them).
  * size: Number of contiguous blocks needed
  * return: Starting block index, or -1 if not found
  */
 static int find_contiguous_blocks(int size) {
     // Edge case: requesting 0 blocks
     if (size == 0) return -1; // Invalid request
+    if (run_tree[1].best < size) return -1;  // No contiguous space found
 
-    // Scan for first contiguous run, skipping block 0 (superblock)
-    for (int start = 1; start <= 128 - size; start++) {
-        int all_free = 1;
-        for (int i = 0; i < size; i++) {
-            if (!is_block_free(start + i)) {
-                all_free = 0;
-                break;
-            }
-        }
-        if (all_free) {
-            return start;
+    // Descend to the leftmost run of at least size blocks. The metadata
+    // blocks are always used, so the run never starts among them.
+    int node = 1, lo = 0, len = tree_leaves;
+    while (len > 1) {
+        run_push(node, len);
+        int half = len / 2;
+        const FreeRun *l = &run_tree[2 * node], *r = &run_tree[2 * node + 1];
+        if (l->best >= size) {
+            node = 2 * node;
+        } else if (l->suf + r->pre >= size) {
+            return lo + half - l->suf;  // Run crossing the middle
+        } else {
+            node = 2 * node + 1;
+            lo += half;
         }
+        len = half;
     }
-    
-    return -1;  // No contiguous space found
+    return lo;
 }
 
 /* ========================================================================
@@ -173,84 +811,255 @@ static int find_contiguous_blocks(int size) {
  * - Copy up to 5 characters
  * - Always null-terminate at position 5
  */
-static void get_inode_name(const Inode *inode, char *dest) {
-    memcpy(dest, inode->name, 5);
+static void get_inode_name(int inode_idx, char *dest) {
+    memcpy(dest, vol_inode_name(&vol, inode_idx), 5);
     dest[5] = '\0';  // Force null termination
 }
 
-/**
- * Stores name into inode (handles 5 maximum)
- */
-static void set_inode_name(Inode *inode, const char *name) {
-    memset(inode->name, 0, 5); //sets first 5 bytes to 0
-    int len = strlen(name);
-    if (len > 5) len = 5; // Limit to 5 characters
-    memcpy(inode->name, name, len); // Copy name into inode
-}
-
 /**
  * Case-insensitive comparison of inode name with target string.
  */
-static int inode_name_equals(const Inode *inode, const char *name) {
+static int inode_name_equals(int inode_idx, const char *name) {
     char inode_name[6]; // Include space for null terminator
-    get_inode_name(inode, inode_name);
+    get_inode_name(inode_idx, inode_name);
     return strcasecmp(inode_name, name) == 0; // Returns 1 if equal, 0 otherwise
 }
 
 /* ========================================================================
  * DISK I/O HELPERS
+ * All block access goes through the block cache above.
  * ======================================================================== */
 
 /**
- * Writes in-memory superblock back to disk
- * Called after any modification to filesystem metadata
+ * Loads every uncached block in [start, end), one pread per uncached run
+ */
+static void cache_load(int start, int end) {
+    for (int b = next_bit(img.valid, start, end, 0); b < end;
+         b = next_bit(img.valid, b, end, 0)) {
+        cache_fill(b, end);
+    }
+}
+
+/**
+ * Marks blocks [start, start + count) as changed in the image
+ */
+static void blocks_written(int start, int count) {
+    for (int b = start; b < start + count; b++) {
+        bit_set(img.valid, b);
+        bit_set(img.dirty, b);
+        bit_clear(img.zero, b);
+    }
+}
+
+/**
+ * Reads count consecutive blocks into data (count * block_size bytes).
+ * A file's blocks are contiguous in the image, so after loading whatever is
+ * not cached yet (one pread per uncached run) this is a single memcpy.
+ */
+static void read_blocks(int start, int count, uint8_t *data) {
+    cache_load(start, start + count);
+    memcpy(data, img.data + (size_t)start * vol.block_size, (size_t)count * vol.block_size);
+}
+
+/**
+ * Writes count consecutive blocks from data (whole blocks only, so there
+ * is nothing to load first)
  */
-static void save_superblock(void) {
-    lseek(disk_fd, 0, SEEK_SET); // Move to start of disk
-    write(disk_fd, &sb, sizeof(Superblock)); // Write superblock
+static void write_blocks(int start, int count, const uint8_t *data) {
+    memcpy(img.data + (size_t)start * vol.block_size, data, (size_t)count * vol.block_size);
+    blocks_written(start, count);
 }
 
 /**
- * Reads a data block from disk into buffer. 
- * Must be 1024 bytes
+ * Copies count consecutive blocks from src to dst (the ranges may overlap)
+ * with a single memmove in the image
  */
-static void read_block(int block_num, uint8_t *data) {
-    lseek(disk_fd, block_num * 1024, SEEK_SET);
-    read(disk_fd, data, 1024);
+static void move_blocks(int dst, int src, int count) {
+    cache_load(src, src + count);
+    memmove(img.data + (size_t)dst * vol.block_size, img.data + (size_t)src * vol.block_size,
+            (size_t)count * vol.block_size);
+    blocks_written(dst, count);
 }
 
 /**
- * Writes a data block from buffer to disk
+ * Checks whether a block of the image is all zeros
  */
-static void write_block(int block_num, const uint8_t *data) {
-    lseek(disk_fd, block_num * 1024, SEEK_SET);
-    write(disk_fd, data, 1024);
+static int block_is_zero(int block_num) {
+    const uint8_t *data = img.data + (size_t)block_num * vol.block_size;
+    return data[0] == 0 && memcmp(data, data + 1, vol.block_size - 1) == 0;
+}
+
+/**
+ * Zeroes count consecutive blocks. Blocks that are already zero in the
+ * image are left alone, so they are not written back again (and holes in
+ * a mapped disk stay unallocated). A block past the end of a short disk
+ * file only reads as zero, so it is still written.
+ */
+static void zero_blocks(int start, int count) {
+    int end = start + count;
+    cache_load(start, end);  // Reading a block is cheaper than writing it back
+
+    for (int b = start; b < end; b++) {
+        if (bit_test(img.zero, b)) continue;
+        if ((b < img.disk_blocks || bit_test(img.dirty, b)) && block_is_zero(b)) {
+            bit_set(img.zero, b);
+            continue;
+        }
+        memset(img.data + (size_t)b * vol.block_size, 0, vol.block_size);
+        bit_set(img.dirty, b);
+        bit_set(img.zero, b);
+    }
 }
 
 /* ========================================================================
  * INODE SEARCH HELPERS
  * ======================================================================== */
 
+static int free_inode_hint = 0;  // No inode below this index is free
+
 /**
  * Finds first unused inode in superblock.
  */
 static int find_free_inode(void) {
-    for (int i = 0; i < 126; i++) {
-        if (!is_inode_used(&sb.inode[i])) {
+    for (int i = free_inode_hint; i < vol.num_inodes; i++) {
+        if (!inode_used(i)) {
+            free_inode_hint = i;
             return i;
         }
     }
+    free_inode_hint = vol.num_inodes;
     return -1;
 }
 
+/* ========================================================================
+ * DIRECTORY INDEX
+ * Built from the inodes at mount and updated by create/delete, so lookups,
+ * cd and ls cost time in proportion to a directory's contents instead of a
+ * scan of every inode:
+ * - each directory (and the root) lists its children in inode order, which
+ *   is the order ls prints them in
+ * - a hash on (parent, case-folded name) finds an entry by name
+ * ======================================================================== */
+
+static int *child_head;     // First child of each directory (root included), -1 = none
+static int *child_count;    // Children of each directory
+static int *sibling_next;   // Next child of the same parent, -1 = last
+static int *sibling_prev;   // Previous child, -1 = first
+static int *hash_head;      // First inode in each bucket, -1 = empty
+static int *hash_next;      // Next inode in the same bucket
+static unsigned hash_mask;  // Buckets - 1 (a power of two, at least 2 * num_inodes)
+
+/**
+ * Hashes a parent index and a name, folding case the way strcasecmp does.
+ * Only the first 5 characters count; longer names cannot match anyway.
+ */
+static uint32_t name_key(int parent, const char *name) {
+    uint32_t h = 2166136261u;  // FNV-1a
+    h = (h ^ (uint32_t)parent) * 16777619u;
+    for (int i = 0; i < 5 && name[i] != '\0'; i++) {
+        h = (h ^ (uint8_t)tolower((unsigned char)name[i])) * 16777619u;
+    }
+    return h;
+}
+
+static unsigned name_hash(int parent, const char *name) {
+    return name_key(parent, name) & hash_mask;
+}
+
+/**
+ * Adds a used inode to its parent's child list (kept in inode order) and
+ * to the name hash.
+ */
+static void dir_index_add(int inode_idx) {
+    int parent = inode_parent(inode_idx);
+
+    // Find the child it goes after
+    int prev = -1;
+    int next = child_head[parent];
+    while (next >= 0 && next < inode_idx) {
+        prev = next;
+        next = sibling_next[next];
+    }
+    sibling_prev[inode_idx] = prev;
+    sibling_next[inode_idx] = next;
+    if (prev >= 0) {
+        sibling_next[prev] = inode_idx;
+    } else {
+        child_head[parent] = inode_idx;
+    }
+    if (next >= 0) sibling_prev[next] = inode_idx;
+    child_count[parent]++;
+
+    char name[6];
+    get_inode_name(inode_idx, name);
+    unsigned h = name_hash(parent, name);
+    hash_next[inode_idx] = hash_head[h];
+    hash_head[h] = inode_idx;
+}
+
+/**
+ * Removes an inode from the index (before it is zeroed)
+ */
+static void dir_index_remove(int inode_idx) {
+    int parent = inode_parent(inode_idx);
+    int prev = sibling_prev[inode_idx];
+    int next = sibling_next[inode_idx];
+    if (prev >= 0) {
+        sibling_next[prev] = next;
+    } else {
+        child_head[parent] = next;
+    }
+    if (next >= 0) sibling_prev[next] = prev;
+    child_count[parent]--;
+
+    char name[6];
+    get_inode_name(inode_idx, name);
+    int *link = &hash_head[name_hash(parent, name)];
+    while (*link != inode_idx) {
+        link = &hash_next[*link];
+    }
+    *link = hash_next[inode_idx];
+}
+
+/**
+ * Rebuilds the index from the mounted disk's inodes
+ */
+static void dir_index_build(void) {
+    size_t dirs = (size_t)vol.num_inodes + 2;  // Every inode index plus the root
+    size_t buckets = 256;
+    while (buckets < 2 * (size_t)vol.num_inodes) buckets *= 2;
+
+    free(child_head);
+    free(child_count);
+    free(sibling_next);
+    free(sibling_prev);
+    free(hash_head);
+    free(hash_next);
+    child_head = xcalloc(dirs, sizeof(int));
+    child_count = xcalloc(dirs, sizeof(int));
+    sibling_next = xcalloc(vol.num_inodes, sizeof(int));
+    sibling_prev = xcalloc(vol.num_inodes, sizeof(int));
+    hash_head = xcalloc(buckets, sizeof(int));
+    hash_next = xcalloc(vol.num_inodes, sizeof(int));
+    hash_mask = buckets - 1;
+    memset(child_head, -1, dirs * sizeof(int));
+    memset(hash_head, -1, buckets * sizeof(int));
+
+    // Inode order, so every insertion appends to its list
+    for (int i = 0; i < vol.num_inodes; i++) {
+        if (inode_used(i)) {
+            dir_index_add(i);
+        }
+    }
+}
+
 /**
  * Searches for file/directory by name in a specific directory.
  */
 static int find_inode_by_name(const char *name, int parent_inode) {
-    for (int i = 0; i < 126; i++) {
-        if (is_inode_used(&sb.inode[i]) &&
-            get_parent_index(&sb.inode[i]) == parent_inode && // Check parent
-            inode_name_equals(&sb.inode[i], name)) { // Check name
+    for (int i = hash_head[name_hash(parent_inode, name)]; i >= 0; i = hash_next[i]) {
+        if (inode_parent(i) == parent_inode && // Check parent
+            inode_name_equals(i, name)) { // Check name
             return i;
         }
     }
@@ -262,15 +1071,8 @@ static int find_inode_by_name(const char *name, int parent_inode) {
  *  This count is used for fs_ls output
  */
 static int count_children(int dir_inode) {
-    int count = 0;
-    for (int i = 0; i < 126; i++) {
-        if (is_inode_used(&sb.inode[i]) &&
-            get_parent_index(&sb.inode[i]) == dir_inode) {
-            count++;
-        }
-    }
     // Add 2 for . and ..
-    return count + 2;
+    return child_count[dir_inode] + 2;
 }
 
 /* ========================================================================
@@ -279,17 +1081,41 @@ static int count_children(int dir_inode) {
  * ======================================================================== */
 
 /**
- * Helper to check block status from a specific unmounted superblock
+ * Loads 8 bytes of the free-space list as one word, block 64w + j at bit
+ * 63 - j (the list is MSB first within each byte)
+ */
+static inline uint64_t load_be64(const uint8_t *p) {
+    uint64_t word = 0;
+    for (int k = 0; k < 8; k++) {
+        word = (word << 8) | p[k];
+    }
+    return word;
+}
+
+/**
+ * Claims blocks [start, end) in an ownership bitmap laid out like the
+ * free-space list words above.
+ * return: 1 if any of them was already claimed, else 0
  */
-static int is_block_free_from_sb(const Superblock *temp_sb, int block_num) {
-    int byte_idx = block_num / 8;
-    int bit_idx = 7 - (block_num % 8);
-    return (temp_sb->free_block_list[byte_idx] & (1 << bit_idx)) == 0;
+static int claim_blocks(uint64_t *owned, int start, int end) {
+    int claimed = 0;
+    while (start < end) {
+        int w = start / 64;
+        int lo = start % 64;
+        int hi = (end - w * 64 < 64) ? end - w * 64 : 64;
+        uint64_t mask = (~0ULL >> lo) & (~0ULL << (64 - hi));
+        if (owned[w] & mask) claimed = 1;
+        owned[w] |= mask;
+        start = w * 64 + hi;
+    }
+    return claimed;
 }
 
 /**
- * Performs 6 consistency checks on a superblock.
+ * Performs 6 consistency checks on a disk's metadata.
  * Returns 0 if all checks pass, or error code (1-6) of first failure.
+ * The limits below are for v0 disks (first data block 1, last block 127,
+ * reserved parent 126, root 127); v1 disks use their own geometry.
  * 
  * CHECK ORDER :
  * 1. Free inodes must be all-zero; used inodes must have nonzero name
@@ -298,233 +1124,244 @@ static int is_block_free_from_sb(const Superblock *temp_sb, int block_num) {
  * 4. Parent index validation (not self, not 126, parent must be dir)
  * 5. Names must be unique within each directory
  * 6. Block allocation matches free-space list
+ *
+ * All six run in one pass over the inodes. The lowest failing check is
+ * kept, so the result is the same as running them one after another:
+ * - a check is skipped once a lower one has failed (it cannot change the
+ *   result), and the pass stops at the first check 1 failure
+ * - check 5 can hash every (parent, name) pair: if no parent is invalid,
+ *   every parent is the root or a used directory, and if one is, check 4
+ *   wins anyway
+ * - check 6 builds an ownership bitmap, trusting a file's blocks only once
+ *   check 2 has passed for it
  */
-static int check_consistency(const Superblock *temp_sb) {
-    /* ====================================================================
-     * CHECK 1: Free inode validation
-     * - If inode is free (bit 7 of isused_size = 0), all 8 bytes must be 0
-     * - If inode is used (bit 7 of isused_size = 1), name[0] must be nonzero
-     * ==================================================================== */
-    for (int i = 0; i < 126; i++) {
-        int used = (temp_sb->inode[i].isused_size & 0x80) != 0;
-        
-        if (!used) {
-            // Free inode: all bytes must be zero
-            const uint8_t *bytes = (const uint8_t*)&temp_sb->inode[i];
-            for (int j = 0; j < 8; j++) {
-                if (bytes[j] != 0) {
-                    return 1;  // Free inode has non-zero data
-                }
-            }
-        } else {
-            // Used inode: name must start with nonzero byte
-            if (temp_sb->inode[i].name[0] == 0) {
-                return 1;  // Used inode has zero name
+static int check_consistency(const Volume *v) {
+    int n = v->num_inodes;
+    int root = n + 1;
+    int64_t last_block = v->num_blocks - 1;
+    size_t record = inode_record_size(v);
+    int err = 7;  // Lowest failing check so far (7 = none)
+
+    size_t words = ((size_t)v->num_blocks + 63) / 64;
+    uint64_t *owned = xcalloc(words, sizeof(uint64_t));  // Bit set = claimed
+
+    // Open-addressed (parent, name) table for check 5; never more than half full
+    size_t slots = 256;
+    while (slots < 2 * (size_t)n) slots *= 2;
+    int *slot = xcalloc(slots, sizeof(int));
+    memset(slot, -1, slots * sizeof(int));
+
+    for (int i = 0; i < n && err > 1; i++) {
+        /* ================================================================
+         * CHECK 1: Free inode validation
+         * - If inode is free (used bit = 0), all of its bytes must be 0
+         * - If inode is used (used bit = 1), name[0] must be nonzero
+         * ================================================================ */
+        const uint8_t *bytes = v->inodes + (size_t)i * record;
+        if (!vol_inode_used(v, i)) {
+            if (bytes[0] != 0 || memcmp(bytes, bytes + 1, record - 1) != 0) {
+                err = 1;  // Free inode has non-zero data
             }
+            continue;
         }
-    }
-    
-    /* ====================================================================
-     * CHECK 2: File block range validation
-     * - For files, start_block must be in [1, 127]
-     * - Last block (start_block + size - 1) must also be in [1, 127]
-     * ==================================================================== */
-    for (int i = 0; i < 126; i++) {
-        int used = (temp_sb->inode[i].isused_size & 0x80) != 0;
-        int is_dir = (temp_sb->inode[i].isdir_parent & 0x80) != 0;
-        
-        if (used && !is_dir) {  // File 
-            int start = temp_sb->inode[i].start_block;
-            int size = temp_sb->inode[i].isused_size & 0x7F;
-            
-            // Check start block in valid range
-            if (start < 1 || start > 127) {
-                return 2;  // start_block out of range
-            }
-            
-            // Check last block in valid range
-            if (start + size - 1 > 127) {
-                return 2;  // file extends beyond disk
-            }
+        if (vol_inode_name(v, i)[0] == 0) {
+            err = 1;  // Used inode has zero name
+            continue;
         }
-    }
-    
-    /* ====================================================================
-     * CHECK 3: Directory metadata validation
-     * - Directories must have size = 0 and start_block = 0
-     * - They don't occupy data blocks 
-     * ==================================================================== */
-    for (int i = 0; i < 126; i++) {
-        int used = (temp_sb->inode[i].isused_size & 0x80) != 0;
-        int is_dir = (temp_sb->inode[i].isdir_parent & 0x80) != 0;
-        
-        if (used && is_dir) {
-            int size = temp_sb->inode[i].isused_size & 0x7F;
-            int start = temp_sb->inode[i].start_block;
-            
-            if (size != 0 || start != 0) {
-                return 3;  // directory has non-zero size/start
-            }
+
+        int is_dir = vol_inode_is_dir(v, i);
+        int64_t start = vol_inode_start(v, i);
+        int64_t size = vol_inode_size(v, i);
+
+        /* ================================================================
+         * CHECK 2: File block range validation
+         * - For files, start_block must be in [1, 127]
+         * - Last block (start_block + size - 1) must also be in [1, 127]
+         * ================================================================ */
+        int in_range = 1;
+        if (!is_dir && (start < v->first_data || start > last_block ||
+                        start + size - 1 > last_block)) {
+            in_range = 0;
+            err = 2;  // start_block out of range, or file extends beyond disk
         }
-    }
-    
-    /* ====================================================================
-     * CHECK 4: Parent index validation
-     * - Parent index cannot equal own index (no self-parenting)
-     * - Parent index cannot be 126 (reserved value)
-     * - If parent is 0-125, parent inode must be used and be a directory
-     * - If parent is 127, it's the root (always valid)
-     * ==================================================================== */
-    for (int i = 0; i < 126; i++) {
-        int used = (temp_sb->inode[i].isused_size & 0x80) != 0;
-        
-        if (used) {
-            int parent = temp_sb->inode[i].isdir_parent & 0x7F;
-            
-            // Check: can't be own parent
-            if (parent == i) {
-                return 4;  // self-parenting
-            }
-            
-            // Check: 126 is reserved
-            if (parent == 126) {
-                return 4;  // invalid parent value
-            }
-            
-            // If parent is regular inode (not root 127)
-            if (parent <= 125) {
-                int parent_used = (temp_sb->inode[parent].isused_size & 0x80) != 0;
-                int parent_is_dir = (temp_sb->inode[parent].isdir_parent & 0x80) != 0;
-                
-                // Parent must exist and be a directory
-                if (!parent_used || !parent_is_dir) {
-                    return 4;  // invalid parent
-                }
-            }
+
+        /* ================================================================
+         * CHECK 3: Directory metadata validation
+         * - Directories must have size = 0 and start_block = 0
+         * ================================================================ */
+        if (err > 3 && is_dir && (size != 0 || start != 0)) {
+            err = 3;  // directory has non-zero size/start
         }
-    }
-    
-    /* ====================================================================
-     * CHECK 5: Name uniqueness within directories
-     *
-     * - Within each directory, all file/directory names must be unique
-     * - Case-insensitive comparison (strcasecmp)
-     * - Names can be duplicated across DIFFERENT directories
-     * 
-     * - For each directory (including root = 127)
-     * - Compare all pairs of children in that directory
-     * ==================================================================== */
-    
-    // Check root directory (parent = 127)
-    for (int i = 0; i < 126; i++) {
-        int used_i = (temp_sb->inode[i].isused_size & 0x80) != 0;
-        if (!used_i) continue;
-        
-        int parent_i = temp_sb->inode[i].isdir_parent & 0x7F;
-        if (parent_i != 127) continue;  // Not in root
-        
-        // Extract name of inode i
-        char name_i[6];
-        memcpy(name_i, temp_sb->inode[i].name, 5);
-        name_i[5] = '\0';
-        
-        // Compare with all subsequent inodes in root
-        for (int j = i + 1; j < 126; j++) {
-            int used_j = (temp_sb->inode[j].isused_size & 0x80) != 0;
-            if (!used_j) continue;
-            
-            int parent_j = temp_sb->inode[j].isdir_parent & 0x7F;
-            if (parent_j != 127) continue;
-            
-            char name_j[6];
-            memcpy(name_j, temp_sb->inode[j].name, 5);
-            name_j[5] = '\0';
-            
-            if (strcasecmp(name_i, name_j) == 0) {
-                return 5;  // duplicate name in directory
-            }
+
+        /* ================================================================
+         * CHECK 4: Parent index validation
+         * - Parent index cannot equal own index (no self-parenting)
+         * - Parent index cannot be 126 (reserved value), nor past the root
+         * - If parent is 0-125, parent inode must be used and be a directory
+         * - If parent is 127, it's the root (always valid)
+         * ================================================================ */
+        int parent = vol_inode_parent(v, i);
+        if (err > 4 && (parent == i || parent == n || parent > root ||
+                        (parent < n && (!vol_inode_used(v, parent) ||
+                                        !vol_inode_is_dir(v, parent))))) {
+            err = 4;  // invalid parent
         }
-    }
-    
-    // Check all other directories (parent = 0-125)
-    for (int dir = 0; dir < 126; dir++) {
-        int used_dir = (temp_sb->inode[dir].isused_size & 0x80) != 0;
-        int is_dir = (temp_sb->inode[dir].isdir_parent & 0x80) != 0;
-        
-        if (!used_dir || !is_dir) continue;  // Skip if not a directory
-        
-        // Check all children of this directory
-        for (int i = 0; i < 126; i++) {
-            int used_i = (temp_sb->inode[i].isused_size & 0x80) != 0;
-            if (!used_i) continue;
-            
-            int parent_i = temp_sb->inode[i].isdir_parent & 0x7F;
-            if (parent_i != dir) continue;
-            
+
+        /* ================================================================
+         * CHECK 5: Name uniqueness within directories
+         * - Case-insensitive comparison (strcasecmp)
+         * - Names can be duplicated across DIFFERENT directories
+         * ================================================================ */
+        if (err > 5) {
             char name_i[6];
-            memcpy(name_i, temp_sb->inode[i].name, 5);
+            memcpy(name_i, vol_inode_name(v, i), 5);
             name_i[5] = '\0';
-            
-            for (int j = i + 1; j < 126; j++) {
-                int used_j = (temp_sb->inode[j].isused_size & 0x80) != 0;
-                if (!used_j) continue;
-                
-                int parent_j = temp_sb->inode[j].isdir_parent & 0x7F;
-                if (parent_j != dir) continue;
-                
+
+            size_t h = name_key(parent, name_i) & (slots - 1);
+            for (; slot[h] >= 0; h = (h + 1) & (slots - 1)) {
+                int j = slot[h];
                 char name_j[6];
-                memcpy(name_j, temp_sb->inode[j].name, 5);
+                memcpy(name_j, vol_inode_name(v, j), 5);
                 name_j[5] = '\0';
-                
-                if (strcasecmp(name_i, name_j) == 0) {
-                    return 5;  // duplicate name
+                if (vol_inode_parent(v, j) == parent && strcasecmp(name_i, name_j) == 0) {
+                    err = 5;  // duplicate name in directory
+                    break;
                 }
             }
+            slot[h] = i;
+        }
+
+        /* ================================================================
+         * CHECK 6 (first half): every file block is claimed exactly once
+         * ================================================================ */
+        if (err > 6 && !is_dir && in_range &&
+            claim_blocks(owned, (int)start, (int)(start + size))) {
+            err = 6;  // block allocated to two files
         }
     }
-    
+
     /* ====================================================================
      * CHECK 6: Block allocation consistency
      *
      * - Blocks marked FREE (bit=0) must not be allocated to any file
      * - Blocks marked USED (bit=1) must be allocated to EXACTLY one file
-     * 
-     * - Count allocations per block across all files
-     * - Compare with free-space list
+     *   (or be a metadata block)
+     *
+     * - The claims above plus the metadata blocks must equal the used
+     *   bits, compared 64 blocks at a time
      * ==================================================================== */
-    int block_count[128] = {0};
+    if (err == 7) {
+        // Files start after the metadata, so these never collide
+        claim_blocks(owned, 0, v->first_data);
 
-    block_count[0] = 1;  // Superblock is always used
-    
-    // Count how many times each block is allocated
-    for (int i = 0; i < 126; i++) {
-        int used = (temp_sb->inode[i].isused_size & 0x80) != 0;
-        int is_dir = (temp_sb->inode[i].isdir_parent & 0x80) != 0;
-        
-        if (used && !is_dir) {  // File
-            int start = temp_sb->inode[i].start_block;
-            int size = temp_sb->inode[i].isused_size & 0x7F;
-            
-            for (int b = start; b < start + size; b++) {
-                block_count[b]++;
+        for (size_t w = 0; w < words; w++) {
+            uint64_t diff = owned[w] ^ load_be64(v->free_list + w * 8);
+            int tail = v->num_blocks - (int)w * 64;  // Blocks left from this word on
+            if (tail < 64) diff &= ~(~0ULL >> tail); // Ignore bits past the last block
+            if (diff) {
+                err = 6;  // free block allocated, or used block unallocated
+                break;
             }
         }
     }
-    
-    // Verify consistency with free-space list
-    for (int b = 0; b < 128; b++) {
-        int is_free = is_block_free_from_sb(temp_sb, b);
-        
-        if (is_free && block_count[b] > 0) {
-            return 6;  //free block is allocated
-        }
-        
-        if (!is_free && block_count[b] != 1) {
-            return 6;  //used block not allocated exactly once
+
+    free(slot);
+    free(owned);
+    return err == 7 ? 0 : err;  // 0 means all checks passed successfully yayyyyyy woohoo
+}
+
+/* ========================================================================
+ * DISK GEOMETRY
+ * ======================================================================== */
+
+/**
+ * Works out a disk's geometry from the start of its block 0 (len bytes of
+ * it could be read, at most 1024): a DiskHeader for v1, else a v0
+ * Superblock. free_list and inodes are left for bind_volume.
+ * return: 0, -1 if too little could be read, -2 if the v1 header is invalid
+ */
+static int read_geometry(const uint8_t *head, ssize_t len, Volume *v) {
+    memset(v, 0, sizeof(*v));
+
+    if (len >= (ssize_t)sizeof(DiskHeader) && memcmp(head, FS_MAGIC, 8) == 0) {
+        DiskHeader h;
+        memcpy(&h, head, sizeof(h));
+
+        uint64_t bitmap_end = (uint64_t)h.bitmap_start + h.bitmap_blocks;
+        uint64_t inode_end = (uint64_t)h.inode_start + h.inode_blocks;
+        uint64_t journal_end = inode_end + h.journal_blocks;
+        if (h.version != FS_VERSION ||
+            h.block_size < FS_MIN_BLOCK_SIZE || h.block_size > FS_MAX_BLOCK_SIZE ||
+            (h.block_size & (h.block_size - 1)) != 0 ||
+            h.num_blocks > INT_MAX / 2 ||
+            h.num_inodes < 1 || h.num_inodes > FS_MAX_INODES ||
+            h.bitmap_start < 1 || bitmap_end > h.inode_start || inode_end >= h.num_blocks ||
+            (uint64_t)h.bitmap_blocks * h.block_size * 8 < h.num_blocks ||
+            (uint64_t)h.inode_blocks * h.block_size < (uint64_t)h.num_inodes * sizeof(InodeV1) ||
+            (h.journal_blocks > 0 && (h.journal_start != inode_end || h.journal_blocks < 2 ||
+                                      journal_end >= h.num_blocks))) {
+            return -2;
         }
+
+        v->version = FS_VERSION;
+        v->block_size = h.block_size;
+        v->num_blocks = h.num_blocks;
+        v->num_inodes = h.num_inodes;
+        v->journal_start = h.journal_blocks > 0 ? (int)inode_end : 0;
+        v->journal_blocks = h.journal_blocks;
+        v->first_data = journal_end;
+        return 0;
     }
-    
-    return 0;  // All checks passed successfully yayyyyyy woohoo
+
+    if (len != sizeof(Superblock)) {
+        return -1;
+    }
+    v->version = 0;
+    v->block_size = V0_BLOCK_SIZE;
+    v->num_blocks = V0_NUM_BLOCKS;
+    v->num_inodes = V0_NUM_INODES;
+    v->first_data = 1;
+    return 0;
+}
+
+/**
+ * Points a volume's free_list and inodes into its disk image
+ */
+static void bind_volume(Volume *v, uint8_t *data) {
+    if (v->version) {
+        const DiskHeader *h = (const DiskHeader *)data;
+        v->free_list = data + (size_t)h->bitmap_start * v->block_size;
+        v->inodes = data + (size_t)h->inode_start * v->block_size;
+    } else {
+        Superblock *sb = (Superblock *)data;
+        v->free_list = sb->free_block_list;
+        v->inodes = (uint8_t *)sb->inode;
+    }
+}
+
+/**
+ * Largest file (in blocks) C accepts: every block after the metadata.
+ * 127 for v0 disks, and when nothing is mounted.
+ */
+static int max_file_size(void) {
+    return is_mounted ? vol.num_blocks - vol.first_data : V0_NUM_BLOCKS - 1;
+}
+
+/**
+ * Grows buffer to BUFFER_BLOCKS blocks of block_size bytes. What it
+ * already holds is kept (the buffer is not zeroed on mount).
+ */
+static void ensure_buffer(int block_size) {
+    size_t need = (size_t)BUFFER_BLOCKS * block_size;
+    if (need <= buffer_size) return;
+    uint8_t *grown = realloc(buffer, need);
+    if (!grown) {
+        perror("realloc");
+        exit(1);
+    }
+    memset(grown + buffer_size, 0, need - buffer_size);
+    buffer = grown;
+    buffer_size = need;
 }
 
 /* ========================================================================
@@ -536,30 +1373,45 @@ static int check_consistency(const Superblock *temp_sb) {
  *  Buffer is NOT zeroed on mount
  */
 void fs_mount(char *name) {
+    /* Write back the current disk first, so remounting it reads its latest state */
+    flush_cache(0);
+
     /* Check if disk file exists */
     int fd = open(name, O_RDWR);
     if (fd < 0) {
         fprintf(stderr, "Error: Cannot find disk %s\n", name); //File doesn't exist
         return;
     }
-    
-    /* Read superblock from disk */
-    Superblock temp_sb;
-    ssize_t bytes_read = read(fd, &temp_sb, sizeof(Superblock));
-    
-    if (bytes_read != sizeof(Superblock)) {
+
+    /* Read the start of block 0 for the disk's format and geometry */
+    uint8_t head[sizeof(Superblock)];
+    Volume new_vol;
+    int rc = read_geometry(head, pread(fd, head, sizeof(head), 0), &new_vol);
+    if (rc == -2) {
+        fprintf(stderr, "Error: Disk %s has an invalid geometry header\n", name);
+        close(fd);
+        return;
+    }
+
+    /* Finish any commit a crash interrupted, then map the disk (FS_SIM_MMAP)
+     * or read its metadata into the cache */
+    uint32_t sequence = rc == 0 ? journal_replay(fd, &new_vol) : 0;
+    Image new_img = {0};
+    if (rc < 0 || open_image(fd, &new_vol, &new_img) < 0) {
         fprintf(stderr, "Error: Cannot find disk %s\n", name); //Failed to read superblock
         close(fd);
         return;
     }
+    bind_volume(&new_vol, new_img.data);
     
     /* Run consistency checks */
-    int error_code = check_consistency(&temp_sb);
+    int error_code = check_consistency(&new_vol);
     
     if (error_code > 0) {
         /* Filesystem is inconsistent - don't mount */
         fprintf(stderr, "Error: File system in %s is inconsistent (error code: %d)\n", //Checks failed (nooo)
                 name, error_code);
+        close_image(&new_img);
         close(fd);
         return;
     }
@@ -568,16 +1420,22 @@ void fs_mount(char *name) {
     
     // Close previous disk if one was mounted
     if (is_mounted && disk_fd >= 0) {
-        close(disk_fd);
+        release_disk();
     }
     
     // Update global state
-    memcpy(&sb, &temp_sb, sizeof(Superblock));
+    vol = new_vol;
+    img = new_img;
+    ensure_buffer(vol.block_size);
+    free_index_build();
+    dir_index_build();
+    free_inode_hint = 0;
+    journal_seq = sequence;
     strncpy(current_disk_name, name, sizeof(current_disk_name) - 1);
     current_disk_name[sizeof(current_disk_name) - 1] = '\0';
     disk_fd = fd;
     is_mounted = 1;
-    current_dir_inode = 127;  // Set CWD to root
+    current_dir_inode = root_inode();  // Set CWD to root
 }
 
 /**
@@ -624,36 +1482,20 @@ void fs_create(char name[5], int size) {
     }
     
     /* create the inode */
-    Inode *inode = &sb.inode[inode_idx];
-    memset(inode, 0, sizeof(Inode));
-    
-    set_inode_name(inode, name);
-    set_inode_used(inode, 1);
-    set_parent_index(inode, current_dir_inode);
-    
     if (size == 0) {
         /* Creating a directory */
-        set_is_directory(inode, 1);
-        set_file_size(inode, 0);
-        inode->start_block = 0;
+        set_inode(inode_idx, name, 1, 0, 0, current_dir_inode);
     } else {
         /* Creating a file */
-        set_is_directory(inode, 0);
-        set_file_size(inode, size);
-        inode->start_block = start_block;
+        set_inode(inode_idx, name, 0, size, start_block, current_dir_inode);
         
         // Mark blocks as used in free-space list
         mark_blocks_used(start_block, size, 1);
         
         // Zero the allocated blocks
-        uint8_t zero_buf[1024] = {0};
-        for (int i = 0; i < size; i++) {
-            write_block(start_block + i, zero_buf);
-        }
+        zero_blocks(start_block, size);
     }
-    
-    /* Write superblock back to disk */
-    save_superblock();
+    dir_index_add(inode_idx);
 }
 
 /**
@@ -663,34 +1505,30 @@ void fs_create(char name[5], int size) {
  * - Zero the inode itself
  */
 static void recursive_delete(int inode_idx) {
-    if (!is_inode_used(&sb.inode[inode_idx])) {
+    if (!inode_used(inode_idx)) {
         return;  // Already free
     }
     
-    if (is_directory(&sb.inode[inode_idx])) {
-        /* Directory: recursively delete all children */
-        for (int i = 0; i < 126; i++) {
-            if (is_inode_used(&sb.inode[i]) &&
-                get_parent_index(&sb.inode[i]) == inode_idx) {
-                recursive_delete(i);
-            }
+    if (inode_is_dir(inode_idx)) {
+        /* Directory: recursively delete all children (each unlinks itself) */
+        while (child_head[inode_idx] >= 0) {
+            recursive_delete(child_head[inode_idx]);
         }
     } else {
         /* File: zero and free data blocks */
-        int start = sb.inode[inode_idx].start_block;
-        int size = get_file_size(&sb.inode[inode_idx]);
+        int start = inode_start(inode_idx);
+        int size = inode_size(inode_idx);
         
-        uint8_t zero_buf[1024] = {0};
-        for (int i = 0; i < size; i++) {
-            write_block(start + i, zero_buf);
-        }
+        zero_blocks(start, size);
         
         // Mark blocks as free
         mark_blocks_used(start, size, 0);
     }
     
     /* Zero the inode */
-    memset(&sb.inode[inode_idx], 0, sizeof(Inode));
+    dir_index_remove(inode_idx);
+    clear_inode(inode_idx);
+    if (inode_idx < free_inode_hint) free_inode_hint = inode_idx;
 }
 
 /**
@@ -711,81 +1549,90 @@ void fs_delete(char name[5]) {
     
     /* Recursively delete */
     recursive_delete(inode_idx);
-    
-    /* Write superblock back to disk */
-    save_superblock();
 }
 
 /**
- * Reads a block from a file into the buffer. * 
+ * Finds a file in the current directory for R/W and checks that blocks
+ * [block_num, block_num + count) are in it.
+ * return: Inode index, or -1 after printing the error
  */
-void fs_read(char name[5], int block_num) {
-    if (!is_mounted) { //Check if filesystem is mounted
-        fprintf(stderr, "Error: No file system is mounted\n"); 
-        return;
-    }
-    
-    /* Find the file */
+static int find_file_range(const char *name, int block_num, int count) {
     int inode_idx = find_inode_by_name(name, current_dir_inode);
     
     // Check: file must exist and must not be a directory
-    if (inode_idx < 0 || is_directory(&sb.inode[inode_idx])) {
+    if (inode_idx < 0 || inode_is_dir(inode_idx)) {
         fprintf(stderr, "Error: File %s does not exist\n", name);
-        return;
+        return -1;
     }
     
-    /* Validate block number is in range [0, size-1] */
-    int size = get_file_size(&sb.inode[inode_idx]);
+    /* Validate block range is in [0, size-1]; report the first missing block */
+    int size = inode_size(inode_idx);
     
     if (block_num < 0 || block_num >= size) {
         fprintf(stderr, "Error: %s does not have block %d\n", name, block_num);
+        return -1;
+    }
+    if (block_num + count > size) {
+        fprintf(stderr, "Error: %s does not have block %d\n", name, size);
+        return -1;
+    }
+    return inode_idx;
+}
+
+/**
+ * Reads count consecutive blocks of a file into buffer blocks 0..count-1.
+ * Files are contiguous, so this is one transfer however many blocks it is.
+ */
+void fs_read_blocks(char name[5], int block_num, int count) {
+    if (!is_mounted) { //Check if filesystem is mounted
+        fprintf(stderr, "Error: No file system is mounted\n"); 
         return;
     }
     
-    /* Read the block into global buffer */
-    int start_block = sb.inode[inode_idx].start_block;
-    int actual_block = start_block + block_num;
+    int inode_idx = find_file_range(name, block_num, count);
+    if (inode_idx < 0) return;
     
-    read_block(actual_block, buffer);
+    /* Read the blocks into global buffer */
+    int start_block = inode_start(inode_idx);
+    read_blocks(start_block + block_num, count, buffer);
 }
 
 /**
- * Writes the buffer to a block in a file.
+ * Writes buffer blocks 0..count-1 to count consecutive blocks of a file.
  * Superblock doesn't need updating (no metadata changes)
  */
-void fs_write(char name[5], int block_num) {
+void fs_write_blocks(char name[5], int block_num, int count) {
     if (!is_mounted) {
         fprintf(stderr, "Error: No file system is mounted\n");
         return;
     }
     
-    /* Find the file */
-    int inode_idx = find_inode_by_name(name, current_dir_inode);
-    
-    // Check: file must exist and must not be a directory
-    if (inode_idx < 0 || is_directory(&sb.inode[inode_idx])) {
-        fprintf(stderr, "Error: File %s does not exist\n", name);
-        return;
-    }
-    
-    /* Validate block number */
-    int size = get_file_size(&sb.inode[inode_idx]);
-    
-    if (block_num < 0 || block_num >= size) {
-        fprintf(stderr, "Error: %s does not have block %d\n", name, block_num);
-        return;
-    }
-    
-    /* Write buffer to the block */
-    int start_block = sb.inode[inode_idx].start_block;
-    int actual_block = start_block + block_num;
+    int inode_idx = find_file_range(name, block_num, count);
+    if (inode_idx < 0) return;
     
-    write_block(actual_block, buffer);
+    /* Write buffer to the blocks */
+    int start_block = inode_start(inode_idx);
+    write_blocks(start_block + block_num, count, buffer);
+}
+
+/**
+ * Reads a block from a file into the buffer.
+ */
+void fs_read(char name[5], int block_num) {
+    fs_read_blocks(name, block_num, 1);
+}
+
+/**
+ * Writes the buffer to a block in a file.
+ */
+void fs_write(char name[5], int block_num) {
+    fs_write_blocks(name, block_num, 1);
 }
 
 /**
  * Updates the buffer with new data.
- * - Remaining bytes stay zero if buff < 1024 bytes
+ * - Remaining bytes stay zero if buff < 1024 bytes, up to the end of the
+ *   buffer block when blocks are larger than 1 KB
  * -  No error checking required per spec
  */
 void fs_buff(uint8_t buff[1024]) {
@@ -796,13 +1643,28 @@ void fs_buff(uint8_t buff[1024]) {
         return;
     }
 
-    // Zero the buffer first
-    memset(buffer, 0, 1024);
+    // Zero the buffer first (a whole block, so no earlier data is left in it)
+    memset(buffer, 0, vol.block_size > 1024 ? (size_t)vol.block_size : 1024);
     
     // Copy new data
     memcpy(buffer, buff, 1024);
 }
 
+/**
+ * Updates the first ceil(len / block_size) buffer blocks with new data, for
+ * B commands. Bytes past len in those blocks are zero.
+ */
+void fs_buff_blocks(const uint8_t *data, size_t len) {
+    if (!is_mounted) {
+        fprintf(stderr, "Error: No file system is mounted\n");
+        return;
+    }
+
+    size_t blocks = (len + vol.block_size - 1) / vol.block_size;
+    memset(buffer, 0, blocks * vol.block_size);
+    memcpy(buffer, data, len);
+}
+
 /**
  * Lists all files and directories in current working directory.
  * - Directory count includes . and .. (add 2 to actual children)
@@ -821,33 +1683,28 @@ void fs_ls(void) {
     printf("%-5s %3d\n", ".", current_count);
     
     /* Print .. (parent directory) */
-    if (current_dir_inode == 127) {
+    if (current_dir_inode == root_inode()) {
         // Root directory: .. is same as .
         printf("%-5s %3d\n", "..", current_count);
     } else {
         // Regular directory: .. is parent
-        int parent_idx = get_parent_index(&sb.inode[current_dir_inode]);
+        int parent_idx = inode_parent(current_dir_inode);
         int parent_count = count_children(parent_idx);
         printf("%-5s %3d\n", "..", parent_count);
     }
     
     /* Print all entries in current directory, sorted by inode index */
-    for (int i = 0; i < 126; i++) {
-        if (is_inode_used(&sb.inode[i]) &&
-            get_parent_index(&sb.inode[i]) == current_dir_inode) {
-            
-            char name[6];
-            get_inode_name(&sb.inode[i], name);
-            
-            if (is_directory(&sb.inode[i])) {
-                /* Directory: show count of children */
-                int child_count = count_children(i);
-                printf("%-5s %3d\n", name, child_count);
-            } else {
-                /* File: show size in KB */
-                int size = get_file_size(&sb.inode[i]);
-                printf("%-5s %3d KB\n", name, size);
-            }
+    for (int i = child_head[current_dir_inode]; i >= 0; i = sibling_next[i]) {
+        char name[6];
+        get_inode_name(i, name);
+        
+        if (inode_is_dir(i)) {
+            /* Directory: show count of children */
+            printf("%-5s %3d\n", name, count_children(i));
+        } else {
+            /* File: show size in KB (rounded up for blocks under 1 KB) */
+            int64_t kb = ((int64_t)inode_size(i) * vol.block_size + 1023) / 1024;
+            printf("%-5s %3lld KB\n", name, (long long)kb);
         }
     }
 }
@@ -872,12 +1729,12 @@ void fs_cd(char name[5]) {
     
     /* Handle special case: ".." (move to parent) */
     if (strcmp(name, "..") == 0) {
-        if (current_dir_inode == 127) {
+        if (current_dir_inode == root_inode()) {
             // Already at root - stay at root
             return;
         } else {
             // Move to parent
-            int parent_idx = get_parent_index(&sb.inode[current_dir_inode]);
+            int parent_idx = inode_parent(current_dir_inode);
             current_dir_inode = parent_idx;
             return;
         }
@@ -887,7 +1744,7 @@ void fs_cd(char name[5]) {
     int inode_idx = find_inode_by_name(name, current_dir_inode);
     
     // Check: must exist and must be a directory
-    if (inode_idx < 0 || !is_directory(&sb.inode[inode_idx])) {
+    if (inode_idx < 0 || !inode_is_dir(inode_idx)) {
         fprintf(stderr, "Error: Directory %s does not exist\n", name);
         return;
     }
@@ -896,11 +1753,31 @@ void fs_cd(char name[5]) {
     current_dir_inode = inode_idx;
 }
 
+//Structure to hold file info for sorting
+typedef struct {
+    int inode_idx;
+    int start_block;
+    int size;
+} FileInfo;
+
+/**
+ * qsort order for defrag: by start block (inode index breaks ties)
+ */
+static int compare_start_block(const void *a, const void *b) {
+    const FileInfo *fa = a, *fb = b;
+    if (fa->start_block != fb->start_block) {
+        return fa->start_block < fb->start_block ? -1 : 1;
+    }
+    return fa->inode_idx - fb->inode_idx;
+}
+
 /**
  * Defragments the disk by moving all used blocks to be contiguous.
- * - All used blocks are packed at beginning (after superblock)
+ * - All used blocks are packed at beginning (after the metadata)
  * - All free blocks are at end
  * - File data is preserved
+ * Files that already sit next to each other move together as one
+ * transfer, and files already in place (and size-0 files) are not touched.
  */
 void fs_defrag(void) {
     if (!is_mounted) {
@@ -908,86 +1785,77 @@ void fs_defrag(void) {
         return;
     }
 
-    //Structure to hold file info for sorting
-    typedef struct {
-        int inode_idx;
-        int start_block;
-        int size;
-    } FileInfo;
-    
-    FileInfo files[126];
+    FileInfo *files = xcalloc(vol.num_inodes, sizeof(FileInfo));
     int file_count = 0;
     
-    // Collect all files 
-    for (int i = 0; i < 126; i++) {
-        if (is_inode_used(&sb.inode[i]) && !is_directory(&sb.inode[i])) {
+    // Collect all files. A size-0 file owns no blocks, so it stays where it is
+    // (it would otherwise tie with the file starting on the same block).
+    for (int i = 0; i < vol.num_inodes; i++) {
+        if (inode_used(i) && !inode_is_dir(i) && inode_size(i) > 0) {
             files[file_count].inode_idx = i;
-            files[file_count].start_block = sb.inode[i].start_block;
-            files[file_count].size = get_file_size(&sb.inode[i]);
+            files[file_count].start_block = inode_start(i);
+            files[file_count].size = inode_size(i);
             file_count++;
         }
     }
     
-    // Sort files by start_block (simple bubble sort)
-    for (int i = 0; i < file_count - 1; i++) {
-        for (int j = i + 1; j < file_count; j++) {
-            if (files[j].start_block < files[i].start_block) {
-                FileInfo temp = files[i];
-                files[i] = files[j];
-                files[j] = temp;
-            }
-        }
-    }
+    // Sort files by start_block
+    qsort(files, file_count, sizeof(FileInfo), compare_start_block);
     
     // Compact files to start of disk
-    uint8_t temp_buf[1024];
-    int next_free = 1;  // Start at block 1 (block 0 is superblock)
-    
-    for (int i = 0; i < file_count; i++) {
-        int inode_idx = files[i].inode_idx;
-        int old_start = sb.inode[inode_idx].start_block;
-        int size = files[i].size;
-        
-        if (old_start != next_free) {
-            /* File needs to be moved */
-            
-            // Copy blocks from old location to new location
-            for (int b = 0; b < size; b++) {
-                read_block(old_start + b, temp_buf);
-                write_block(next_free + b, temp_buf);
+    int next_free = vol.first_data;  // Start right after the superblock (v1: inode table)
+    
+    for (int i = 0; i < file_count; ) {
+        // Gather the run of files that follow each other with no gap
+        int run_start = files[i].start_block;
+        int run_size = files[i].size;
+        int j = i + 1;
+        while (j < file_count && files[j].start_block == run_start + run_size) {
+            run_size += files[j].size;
+            j++;
+        }
+
+        if (run_start != next_free) {
+            /* Run needs to be moved: every file in it shifts down by the same amount.
+             * Sources are in disk order and move down, so a destination only ever
+             * overlaps its own source or blocks that have already been moved out. */
+            move_blocks(next_free, run_start, run_size);
+
+            // Update inodes with new start_block
+            for (int k = i; k < j; k++) {
+                set_start_block(files[k].inode_idx, next_free + files[k].start_block - run_start);
             }
-            
-            // Update inode with new start_block
-            sb.inode[inode_idx].start_block = next_free;
         }
         
         // Advance next_free pointer
-        next_free += size;
+        next_free += run_size;
+        i = j;
     }
     
-     // Clear remaining blocks on disk
-     memset(temp_buf, 0, 1024);
-    for (int b = next_free; b < 128; b++) {
-        write_block(b, temp_buf);
-    }
+    // Clear remaining blocks on disk (the ones not already zero)
+    zero_blocks(next_free, vol.num_blocks - next_free);
     
-    // Clear free-space list (all blocks initially free)
-    memset(sb.free_block_list, 0, 16);
+    // Rebuild free-space list: metadata and files now fill [0, next_free)
+    size_t bitmap_bytes = ((size_t)vol.num_blocks + 7) / 8;
+    memset(vol.free_list, 0, bitmap_bytes);
+    meta_dirty(vol.free_list, bitmap_bytes);
+    free_index_build();
+    mark_blocks_used(0, next_free, 1);
     
-    // Mark superblock as used
-    set_block_free(0, 0);
-    
-    // Mark all file blocks as used
-    for (int i = 0; i < file_count; i++) {
-        int inode_idx = files[i].inode_idx;
-        int start = sb.inode[inode_idx].start_block;
-        int size = files[i].size;
-        
-        mark_blocks_used(start, size, 1);
+    free(files);
+}
+
+/**
+ * Writes all cached changes back to the disk and waits for them to reach
+ * stable storage.
+ */
+void fs_sync(void) {
+    if (!is_mounted) {
+        fprintf(stderr, "Error: No file system is mounted\n");
+        return;
     }
-    
-    /* Write updated superblock to disk */
-    save_superblock();
+
+    flush_cache(1);
 }
 
 /**
@@ -1002,18 +1870,20 @@ void fs_defrag(void) {
  * M <disk_name>                  - Mount
  * C <file_name> <size>           - Create
  * D <file_name>                  - Delete
- * R <file_name> <block_num>      - Read
- * W <file_name> <block_num>      - Write
- * B <characters>                 - Buffer update
+ * R <file_name> <block_num> [n] - Read (n blocks into buffer blocks 0..n-1)
+ * W <file_name> <block_num> [n] - Write (n buffer blocks)
+ * B <characters>                 - Buffer update (spills into later blocks past one)
  * L                              - List
  * O                              - Defragment
  * Y <directory_name>             - Change directory
+ * S                              - Sync cached changes to disk
  * 
  * ERRORS
  * - Invalid command letter
  * - Wrong number of arguments
  * - Invalid argument format
- * - Argument out of range
+ * - Argument out of range (sizes and blocks follow the mounted disk's
+ *   geometry; 127 / 126 for v0 disks and when nothing is mounted)
  */
 static int parse_and_execute_command(char *line, int line_num, const char *input_file) {
     // 1. Robust check for empty or whitespace-only lines
@@ -1046,7 +1916,7 @@ static int parse_and_execute_command(char *line, int line_num, const char *input
     
     switch (cmd) {
         case 'M': {
-            if (sscanf(args, "%s %s", arg1, extra) != 1) {
+            if (sscanf(args, "%255s %255s", arg1, extra) != 1) {
                 fprintf(stderr, "Command Error: %s, %d\n", input_file, line_num);
                 return 0;
             }
@@ -1054,12 +1924,12 @@ static int parse_and_execute_command(char *line, int line_num, const char *input
             break;
         }
         case 'C': {
-            if (sscanf(args, "%s %d %s", arg1, &num_arg, extra) != 2) {
+            if (sscanf(args, "%255s %d %255s", arg1, &num_arg, extra) != 2) {
                 fprintf(stderr, "Command Error: %s, %d\n", input_file, line_num);
                 return 0;
             }
             // Constraint checks
-            if (strlen(arg1) > 5 || num_arg < 0 || num_arg > 127) {
+            if (strlen(arg1) > 5 || num_arg < 0 || num_arg > max_file_size()) {
                 fprintf(stderr, "Command Error: %s, %d\n", input_file, line_num);
                 return 0;
             }
@@ -1067,7 +1937,7 @@ static int parse_and_execute_command(char *line, int line_num, const char *input
             break;
         }
         case 'D': {
-            if (sscanf(args, "%s %s", arg1, extra) != 1) {
+            if (sscanf(args, "%255s %255s", arg1, extra) != 1) {
                 fprintf(stderr, "Command Error: %s, %d\n", input_file, line_num);
                 return 0;
             }
@@ -1079,27 +1949,41 @@ static int parse_and_execute_command(char *line, int line_num, const char *input
             break;
         }
         case 'R': {
-            if (sscanf(args, "%s %d %s", arg1, &num_arg, extra) != 2) {
+            // Optional third argument: number of blocks
+            int count = 1;
+            int nargs = sscanf(args, "%255s %d %255s", arg1, &num_arg, extra);
+            if (nargs == 3) {
+                nargs = sscanf(args, "%255s %d %d %255s", arg1, &num_arg, &count, extra) == 3 ? 2 : 0;
+            }
+            if (nargs != 2) {
                 fprintf(stderr, "Command Error: %s, %d\n", input_file, line_num);
                 return 0;
             }
-            if (strlen(arg1) > 5 || num_arg < 0 || num_arg > 126) {
+            if (strlen(arg1) > 5 || num_arg < 0 || num_arg > max_file_size() - 1 ||
+                count < 1 || count > BUFFER_BLOCKS) {
                 fprintf(stderr, "Command Error: %s, %d\n", input_file, line_num);
                 return 0;
             }
-            fs_read(arg1, num_arg);
+            fs_read_blocks(arg1, num_arg, count);
             break;
         }
         case 'W': {
-            if (sscanf(args, "%s %d %s", arg1, &num_arg, extra) != 2) {
+            // Optional third argument: number of blocks
+            int count = 1;
+            int nargs = sscanf(args, "%255s %d %255s", arg1, &num_arg, extra);
+            if (nargs == 3) {
+                nargs = sscanf(args, "%255s %d %d %255s", arg1, &num_arg, &count, extra) == 3 ? 2 : 0;
+            }
+            if (nargs != 2) {
                 fprintf(stderr, "Command Error: %s, %d\n", input_file, line_num);
                 return 0;
             }
-            if (strlen(arg1) > 5 || num_arg < 0 || num_arg > 126) {
+            if (strlen(arg1) > 5 || num_arg < 0 || num_arg > max_file_size() - 1 ||
+                count < 1 || count > BUFFER_BLOCKS) {
                 fprintf(stderr, "Command Error: %s, %d\n", input_file, line_num);
                 return 0;
             }
-            fs_write(arg1, num_arg);
+            fs_write_blocks(arg1, num_arg, count);
             break;
         }
         case 'B': {
@@ -1107,13 +1991,19 @@ static int parse_and_execute_command(char *line, int line_num, const char *input
                 fprintf(stderr, "Command Error: %s, %d\n", input_file, line_num);
                 return 0;
             }
-            // Check length limit
-            if (strlen(args) > 1024) {
+            // Check length limit (the whole multi-block buffer)
+            size_t len = strlen(args);
+            size_t block_size = is_mounted ? (size_t)vol.block_size : V0_BLOCK_SIZE;
+            if (len > BUFFER_BLOCKS * block_size) {
                 fprintf(stderr, "Command Error: %s, %d\n", input_file, line_num);
                 return 0;
             }
+            if (len > 1024) {
+                fs_buff_blocks((const uint8_t *)args, len);
+                break;
+            }
             uint8_t new_buf[1024] = {0};
-            memcpy(new_buf, args, strlen(args));
+            memcpy(new_buf, args, len);
             fs_buff(new_buf);
             break;
         }
@@ -1134,7 +2024,7 @@ static int parse_and_execute_command(char *line, int line_num, const char *input
             break;
         }
         case 'Y': {
-            if (sscanf(args, "%s %s", arg1, extra) != 1) {
+            if (sscanf(args, "%255s %255s", arg1, extra) != 1) {
                 fprintf(stderr, "Command Error: %s, %d\n", input_file, line_num);
                 return 0;
             }
@@ -1145,6 +2035,14 @@ static int parse_and_execute_command(char *line, int line_num, const char *input
             fs_cd(arg1);
             break;
         }
+        case 'S': {
+            if (*args != '\0') {
+                fprintf(stderr, "Command Error: %s, %d\n", input_file, line_num);
+                return 0;
+            }
+            fs_sync();
+            break;
+        }
         default:
             fprintf(stderr, "Command Error: %s, %d\n", input_file, line_num);
             return 0;
@@ -1166,22 +2064,29 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
+    /* Optional mmap disk mode */
+    const char *mmap_env = getenv("FS_SIM_MMAP");
+    use_mmap = mmap_env && *mmap_env && strcmp(mmap_env, "0") != 0;
+
     /* Initialize buffer to zero */
-    memset(buffer, 0, 1024);
+    ensure_buffer(V0_BLOCK_SIZE);
     
-    /* Read and execute commands line by line */
-    char line[2048];
+    /* Read and execute commands line by line (a B line can be ~127 KB) */
+    char *line = NULL;
+    size_t line_cap = 0;
     int line_num = 0;
     
-    while (fgets(line, sizeof(line), input)) {
+    while (getline(&line, &line_cap, input) != -1) {
         line_num++;
         parse_and_execute_command(line, line_num, argv[1]);
     }
     
     /* Cleanup */
+    free(line);
     fclose(input);
+    flush_cache(0);
     if (is_mounted && disk_fd >= 0) {
-        close(disk_fd);
+        release_disk();
     }
     
     return 0;
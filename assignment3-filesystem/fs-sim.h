@@ -7,6 +7,7 @@
 #ifndef FS_SIM_H
 #define FS_SIM_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 /**
@@ -34,6 +35,69 @@ typedef struct __attribute__((packed)) {
     Inode inode[126];
 } Superblock;
 
+/**
+ * Version 1 disks: configurable geometry
+ * Version 0 is the format above (128 blocks of 1 KB, Superblock in block 0).
+ * A version 1 disk starts with a DiskHeader in block 0, followed by:
+ *   bitmap_start ... + bitmap_blocks   free-space list (1 bit per block, MSB first)
+ *   inode_start  ... + inode_blocks    inode table (InodeV1 records)
+ *   journal_start ... + journal_blocks optional metadata journal (right after
+ *                                      the inode table; 0 blocks = none)
+ *   remaining blocks                   file data
+ * Every metadata block (header, bitmap, inodes, journal) is marked used.
+ * Multi-byte fields are little-endian.
+ */
+#define FS_MAGIC "FSSIMv1"     // 8 bytes with the terminator; never a valid v0 block 0
+#define FS_VERSION 1
+#define FS_MIN_BLOCK_SIZE 512
+#define FS_MAX_BLOCK_SIZE 65536
+#define FS_MAX_INODES 65534    // Parents are 16 bits and the root is num_inodes + 1
+
+typedef struct __attribute__((packed)) {
+    char magic[8];           // FS_MAGIC
+    uint32_t version;        // FS_VERSION
+    uint32_t block_size;     // bytes per block, a power of two
+    uint32_t num_blocks;     // blocks on the disk, metadata included
+    uint32_t num_inodes;     // inode slots
+    uint32_t bitmap_start;   // first block of the free-space list
+    uint32_t bitmap_blocks;
+    uint32_t inode_start;    // first block of the inode table
+    uint32_t inode_blocks;
+    uint32_t journal_start;  // first block of the journal (0 with no journal)
+    uint32_t journal_blocks; // JournalHeader block + logged block copies
+} DiskHeader;
+
+/**
+ * Version 1 Inode Structure (16 bytes)
+ * Parent index num_inodes is reserved and num_inodes + 1 is the root,
+ * as 126 and 127 are in version 0.
+ */
+typedef struct __attribute__((packed)) {
+    char name[5];            // name of the file/directory
+    uint8_t flags;           // bit 7 = status (1=used), bit 6 = type (1=dir)
+    uint16_t parent;         // index of the parent inode
+    uint32_t start_block;    // index of the first block of the file
+    uint32_t size;           // size of the file in blocks
+} InodeV1;
+
+/**
+ * Journal header: first block of the journal region
+ * A commit logs copies of the changed bitmap/inode blocks in the journal
+ * blocks that follow (in target order) and then makes them durable; only
+ * then are they written to their home blocks. count = 0 means nothing to
+ * replay. checksum is FNV-1a over sequence, count, target[] and the copies,
+ * so a torn commit is ignored.
+ */
+#define FS_JOURNAL_MAGIC "FSJRNL1"
+
+typedef struct __attribute__((packed)) {
+    char magic[8];           // FS_JOURNAL_MAGIC
+    uint32_t sequence;       // commit number
+    uint32_t count;          // blocks logged
+    uint32_t checksum;
+    uint32_t target[];       // home block of each logged copy
+} JournalHeader;
+
 /* Function prototypes - implementations in fs-sim.c */
 void fs_mount(char *new_disk_name);
 void fs_create(char name[5], int size);
@@ -41,8 +105,12 @@ void fs_delete(char name[5]);
 void fs_read(char name[5], int block_num);
 void fs_write(char name[5], int block_num);
 void fs_buff(uint8_t buff[1024]);
+void fs_read_blocks(char name[5], int block_num, int count);
+void fs_write_blocks(char name[5], int block_num, int count);
+void fs_buff_blocks(const uint8_t *data, size_t len);
 void fs_ls(void);
 void fs_defrag(void);
 void fs_cd(char name[5]);
+void fs_sync(void);
 
 #endif /* FS_SIM_H */
\ No newline at end of file
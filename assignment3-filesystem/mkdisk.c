@@ -0,0 +1,135 @@
+/**
+ * CMPUT 379 Assignment 3 - Version 1 Disk Creator
+ * Name: Chidinma Obi-Okoye
+ * CCID: obiokoye
+ *
+ * Creates an empty version 1 disk (see fs-sim.h) with a chosen geometry:
+ *   ./mkdisk <disk_name> <num_blocks> [block_size [num_inodes [journal_blocks]]]
+ * The journal is sized to log every metadata block at once unless given
+ * (0 = no journal).
+ * Version 0 (128 KB) disks are still made with create_fs.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "fs-sim.h"
+
+/**
+ * Parses a whole decimal argument.
+ * return: The value, or -1 if it is not a number in [1, INT_MAX / 2]
+ */
+static long parse_count(const char *arg) {
+    char *end;
+    long value = strtol(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || value < 1 || value > INT_MAX / 2) {
+        return -1;
+    }
+    return value;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3 || argc > 6) {
+        fprintf(stderr, "Usage: %s <disk_name> <num_blocks> [block_size [num_inodes [journal_blocks]]]\n",
+                argv[0]);
+        return 1;
+    }
+
+    long num_blocks = parse_count(argv[2]);
+    long block_size = argc > 3 ? parse_count(argv[3]) : 1024;
+    long num_inodes = num_blocks / 8;  // One inode per 8 blocks by default
+    if (num_inodes < 126) num_inodes = 126;
+    if (num_inodes > FS_MAX_INODES) num_inodes = FS_MAX_INODES;
+    if (argc > 4) num_inodes = parse_count(argv[4]);
+    long journal_blocks = -1;  // Default: sized below
+    if (argc > 5) journal_blocks = strcmp(argv[5], "0") == 0 ? 0 : parse_count(argv[5]);
+
+    /* Geometry must be one fs accepts */
+    if (num_blocks < 0) {
+        fprintf(stderr, "Error: number of blocks must be in [1, %d]\n", INT_MAX / 2);
+        return 1;
+    }
+    if (block_size < FS_MIN_BLOCK_SIZE || block_size > FS_MAX_BLOCK_SIZE ||
+        (block_size & (block_size - 1)) != 0) {
+        fprintf(stderr, "Error: block size must be a power of two in [%d, %d]\n",
+                FS_MIN_BLOCK_SIZE, FS_MAX_BLOCK_SIZE);
+        return 1;
+    }
+    if (num_inodes < 1 || num_inodes > FS_MAX_INODES) {
+        fprintf(stderr, "Error: number of inodes must be in [1, %d]\n", FS_MAX_INODES);
+        return 1;
+    }
+    if (argc > 5 && (journal_blocks < 0 || journal_blocks == 1)) {
+        fprintf(stderr, "Error: journal must be 0 or at least 2 blocks\n");
+        return 1;
+    }
+
+    /* Lay out the metadata: header, free-space list, inode table, journal */
+    DiskHeader h = {0};
+    memcpy(h.magic, FS_MAGIC, sizeof(h.magic));
+    h.version = FS_VERSION;
+    h.block_size = block_size;
+    h.num_blocks = num_blocks;
+    h.num_inodes = num_inodes;
+    h.bitmap_start = 1;
+    h.bitmap_blocks = (num_blocks + block_size * 8 - 1) / (block_size * 8);
+    h.inode_start = h.bitmap_start + h.bitmap_blocks;
+    h.inode_blocks = (num_inodes * sizeof(InodeV1) + block_size - 1) / block_size;
+    if (journal_blocks < 0) {
+        // Header block plus a copy of every bitmap and inode block, as far
+        // as the header has room for targets
+        long logged = h.bitmap_blocks + h.inode_blocks;
+        long targets = (block_size - (long)sizeof(JournalHeader)) / (long)sizeof(uint32_t);
+        journal_blocks = 1 + (logged < targets ? logged : targets);
+    }
+    h.journal_start = journal_blocks ? h.inode_start + h.inode_blocks : 0;
+    h.journal_blocks = journal_blocks;
+
+    long first_data = (long)h.inode_start + h.inode_blocks + journal_blocks;
+    if (first_data >= num_blocks) {
+        fprintf(stderr, "Error: %ld blocks leave no room for data after %ld metadata blocks\n",
+                num_blocks, first_data);
+        return 1;
+    }
+
+    /* Build the metadata blocks; everything after them stays zero */
+    size_t meta_size = (size_t)first_data * block_size;
+    uint8_t *meta = calloc(meta_size, 1);
+    if (!meta) {
+        perror("calloc");
+        return 1;
+    }
+    memcpy(meta, &h, sizeof(h));
+
+    // Metadata blocks are used (bit 7 of byte 0 is block 0)
+    uint8_t *free_list = meta + (size_t)h.bitmap_start * block_size;
+    for (long b = 0; b < first_data; b++) {
+        free_list[b / 8] |= 1 << (7 - b % 8);
+    }
+
+    int fd = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(argv[1]);
+        free(meta);
+        return 1;
+    }
+    // ftruncate leaves the data blocks as a hole rather than writing zeros
+    if (pwrite(fd, meta, meta_size, 0) != (ssize_t)meta_size ||
+        ftruncate(fd, (off_t)num_blocks * block_size) < 0) {
+        perror(argv[1]);
+        close(fd);
+        free(meta);
+        return 1;
+    }
+    close(fd);
+    free(meta);
+
+    printf("%s: %ld blocks of %ld bytes, %ld inodes, %ld journal blocks, data from block %ld\n",
+           argv[1], num_blocks, block_size, num_inodes, journal_blocks, first_data);
+    return 0;
+}
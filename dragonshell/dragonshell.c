@@ -1,10 +1,11 @@
 // dragonshell.c
 // A simple shell program with job control, I/O redirection, and piping.
 
+#define _GNU_SOURCE   // For pipe2, vmsplice, fmemopen and F_SETPIPE_SZ
 #include <string.h>   // For string manipulation (strtok, strcmp, strncpy, etc.)
-#include <stdio.h>    // For standard I/O (printf, fgets, perror)
+#include <stdio.h>    // For standard I/O (printf, perror)
 #include <stdlib.h>   // For general utilities (malloc, free, exit)
-#include <unistd.h>   // For POSIX functions (chdir, getcwd, fork, execve, dup2, setpgid)
+#include <unistd.h>   // For POSIX functions (chdir, getcwd, access, close, setpgid)
 #include <limits.h>   // For system limits (PATH_MAX)
 #include <errno.h>    // For error number checking (e.g., in waitpid)
 #include <sys/types.h> // For various data types (pid_t)
@@ -13,25 +14,48 @@
 #include <signal.h>   // For signal handling (sigaction, kill, signal)
 #include <termios.h>  // For definition of STDIN_FILENO
 #include <sys/ioctl.h>
+#include <sys/stat.h> // For stat (PATH lookup)
+#include <spawn.h>    // For posix_spawn and its file actions / attributes
+#include <sys/mman.h> // For mmap (pipeline builtin output pages)
+#include <sys/uio.h>  // For vmsplice and struct iovec
+#include <sys/signalfd.h> // For signalfd (SIGCHLD as a readable fd)
+#include <poll.h>     // For poll (waiting on stdin and SIGCHLD together)
 
 // ---------------- Design Constants ----------------
 #define LINE_LENGTH 100 // max # of characters in an input line
 #define MAX_ARGS 20      // max # of args to a command (not incl. command name)
 #define MAX_LENGTH 20   // max # of characters in an argument
+#define PATH_CACHE_SLOTS 64 // slots in the PATH lookup cache (power of 2)
+#define MAX_STAGES ((MAX_ARGS + 2) / 2) // max # of commands in one pipeline
+#define JOB_TABLE_MIN_BUCKETS 64 // initial buckets in the job table (power of 2)
+#define INPUT_BUFFER 4096 // bytes of stdin read ahead by read_line
 
 // --- Job Control Data Structure ---
-// Design: Linked list node to track background/suspended jobs.
-// Process table structure for tracking jobs
+// Design: Jobs are kept in a hash table keyed by pid (chained buckets), so a
+// child's state change is applied in O(1) however many jobs there are. Every
+// job is also on a doubly linked list, newest first, which is the order
+// `jobs` prints them in.
 typedef struct process
 {
   pid_t pid;
   char state; // 'R' for running (background), 'T' for suspended (stopped)
   char command[LINE_LENGTH]; // Command line for display in `jobs`
-  struct process *next;
+  struct process *next;      // next (older) job in `jobs` order
+  struct process *prev;      // previous (newer) job
+  struct process *hash_next; // next job in the same bucket
 } process_t;
 
-// Global head of the job control linked list
+// Global head of the job list (newest job)
 static process_t *process_table = NULL;
+static process_t **job_buckets = NULL;
+static size_t job_bucket_count = 0; // power of 2 (0 = not allocated yet)
+static size_t job_count = 0;
+
+// --- Child Reaping ---
+// Design: SIGCHLD stays blocked in the shell and is read from a signalfd in
+// the main loop, so the job table is only ever changed outside signal context.
+static int sigchld_fd = -1;
+static sigset_t child_sigmask; // the shell's mask before SIGCHLD was blocked
 
 // --- Global Foreground Process Tracking ---
 // Design: Used by signal handlers (SIGINT/SIGTSTP) to direct signals to the
@@ -39,28 +63,29 @@ static process_t *process_table = NULL;
 static pid_t foreground_pid = -1;
 static pid_t foreground_pgid = -1;
 
-// Global environment variable pointer, required by execve
+// Global environment variable pointer, passed to posix_spawn
 extern char **environ; 
 
 // --- Function Forward Declarations ---
-static void setup_signal_handlers(void);
-static void sigchld_handler(int);
+static int setup_signal_handlers(void);
+static void reap_children(void);
 static void sigint_handler(int);
 static void sigtstp_handler(int);
 static void add_process(pid_t pid, char state, const char *cmd);
-static void remove_process(pid_t pid);
-static void update_process_state(pid_t pid, char state);
-static void print_jobs_impl(void);
+static void job_apply_status(pid_t pid, int status);
+static void print_jobs_impl(FILE *out);
 static void cleanup_processes(void);
 
 static void parse_command(char **tokens, int *background,
                           char **input_file, char **output_file,
-                          char ***pipe_rhs);
+                          char **stages[], int *num_stages);
 
 static void execute_external(char **argv, int background,
                              char *in, char *out);
-static void execute_pipe(char **lhs, char **rhs);
+static void execute_pipe(char **stages[], int num_stages, int background,
+                         char *in, char *out);
 static void strip_quotes(char *s);
+static void path_cache_clear(void);
 
 // ---------------- Tokenizer ----------------
 /**
@@ -90,14 +115,15 @@ void tokenize(char *str, const char *delim, char **argv)
 
 /**
  * @brief Prints the current working directory.
+ * @param out - Stream to print to (stdout, or a pipeline stage's buffer).
  */
-static void bi_pwd(void)
+static void bi_pwd(FILE *out)
 {
   char buf[PATH_MAX];
   if (getcwd(buf, sizeof(buf)))
   {
-    printf("%s\n", buf);
-    fflush(stdout);
+    fprintf(out, "%s\n", buf);
+    fflush(out);
   }
   else
   {
@@ -119,15 +145,18 @@ static void bi_cd(char *path)
   if (chdir(path) < 0)
   {
     fprintf(stderr, "dragonshell: No such file or directory\n");
+    return;
   }
+  path_cache_clear(); // relative PATH entries now point elsewhere
 }
 
 /**
  * @brief Lists all running and suspended background jobs.
+ * @param out - Stream to print to (stdout, or a pipeline stage's buffer).
  */
-static void bi_jobs(void)
+static void bi_jobs(FILE *out)
 {
-  print_jobs_impl(); // Calls the internal printing helper
+  print_jobs_impl(out); // Calls the internal printing helper
 }
 
 /**
@@ -163,22 +192,179 @@ static void strip_quotes(char *s)
   }
 }
 
+// ---------------- PATH lookup cache ----------------
+// Design: Bare command names are resolved against PATH once and remembered
+// in a small open-addressing hash table, so repeated launches of the same
+// program skip the directory walk. The cache is dropped on a successful `cd`
+// and whenever the PATH value differs from the one it was filled with.
+
+typedef struct
+{
+  char *name; // command as typed (NULL = empty slot)
+  char *path; // resolved executable
+} path_cache_entry_t;
+
+static path_cache_entry_t path_cache[PATH_CACHE_SLOTS];
+static int path_cache_count = 0;
+static char *path_cache_env = NULL; // PATH the cache was filled with
+
+static unsigned int path_cache_hash(const char *name)
+{
+  unsigned int h = 5381;
+  while (*name)
+    h = h * 33 + (unsigned char)*name++;
+  return h & (PATH_CACHE_SLOTS - 1);
+}
+
+/**
+ * @brief Forgets every cached lookup.
+ */
+static void path_cache_clear(void)
+{
+  for (int i = 0; i < PATH_CACHE_SLOTS; ++i)
+  {
+    free(path_cache[i].name);
+    free(path_cache[i].path);
+    path_cache[i].name = NULL;
+    path_cache[i].path = NULL;
+  }
+  path_cache_count = 0;
+  free(path_cache_env);
+  path_cache_env = NULL;
+}
+
+/**
+ * @brief Returns the slot holding name, or the empty slot where it belongs.
+ */
+static path_cache_entry_t *path_cache_slot(const char *name)
+{
+  unsigned int i = path_cache_hash(name);
+  while (path_cache[i].name && strcmp(path_cache[i].name, name) != 0)
+    i = (i + 1) & (PATH_CACHE_SLOTS - 1);
+  return &path_cache[i];
+}
+
+static int is_executable(const char *path)
+{
+  struct stat st;
+  return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+/**
+ * @brief Resolves the program to run for a command name.
+ * Design: Names containing '/' run exactly as typed; anything else is looked
+ * up in PATH through the cache. Only a name PATH does not have falls back
+ * to an executable in the current directory (the original behaviour), so a
+ * file there named `ls` does not shadow /bin/ls.
+ * @return The path to hand to posix_spawn, or NULL if nothing matches.
+ */
+static const char *resolve_command(const char *name)
+{
+  if (strchr(name, '/'))
+    return name;
+
+  const char *env = getenv("PATH");
+  if (!env || !*env)
+    return is_executable(name) ? name : NULL;
+
+  // PATH changed since the cache was filled → start over
+  if (!path_cache_env || strcmp(path_cache_env, env) != 0)
+  {
+    path_cache_clear();
+    path_cache_env = strdup(env);
+  }
+
+  path_cache_entry_t *slot = path_cache_slot(name);
+  if (slot->name)
+    return slot->path;
+
+  char candidate[PATH_MAX];
+  for (const char *dir = env; ; )
+  {
+    const char *end = strchr(dir, ':');
+    size_t len = end ? (size_t)(end - dir) : strlen(dir);
+    // An empty PATH entry means the current directory
+    int n = len ? snprintf(candidate, sizeof(candidate), "%.*s/%s", (int)len, dir, name)
+                : snprintf(candidate, sizeof(candidate), "./%s", name);
+    if (n > 0 && (size_t)n < sizeof(candidate) && is_executable(candidate))
+    {
+      // Keep the load factor <= 50%; a full cache is simply restarted
+      if (path_cache_count * 2 >= PATH_CACHE_SLOTS)
+      {
+        char *keep = path_cache_env;
+        path_cache_env = NULL;
+        path_cache_clear();
+        path_cache_env = keep;
+        slot = path_cache_slot(name);
+      }
+      slot->name = strdup(name);
+      slot->path = strdup(candidate);
+      path_cache_count++;
+      return slot->path;
+    }
+    if (!end)
+      break;
+    dir = end + 1;
+  }
+  return is_executable(name) ? name : NULL;
+}
+
+/**
+ * @brief Drops a cached lookup whose target could not be started.
+ */
+static void path_cache_forget(const char *name)
+{
+  if (strchr(name, '/') || !path_cache_env)
+    return;
+  path_cache_entry_t *slot = path_cache_slot(name);
+  if (!slot->name)
+    return;
+
+  // Re-insert the rest of the probe run so later lookups still find it
+  path_cache_entry_t removed = *slot;
+  slot->name = NULL;
+  slot->path = NULL;
+  path_cache_count--;
+  unsigned int i = (unsigned int)(slot - path_cache);
+  for (i = (i + 1) & (PATH_CACHE_SLOTS - 1); path_cache[i].name;
+       i = (i + 1) & (PATH_CACHE_SLOTS - 1))
+  {
+    path_cache_entry_t moved = path_cache[i];
+    path_cache[i].name = NULL;
+    path_cache[i].path = NULL;
+    *path_cache_slot(moved.name) = moved;
+  }
+  free(removed.name);
+  free(removed.path);
+}
+
 // ---------------- signal setup ----------------
 /**
  * @brief Configures the signal handlers for the shell process.
  * Design: The shell process must ignore or handle certain signals to maintain job control.
+ * @return 0 on success, -1 if SIGCHLD cannot be read from a signalfd.
  */
-static void setup_signal_handlers(void)
+static int setup_signal_handlers(void)
 {
+  // SIGCHLD: Mandatory for job control. It is blocked for good and read from
+  // sigchld_fd instead of running a handler (see reap_children); children
+  // start with the mask from before (child_sigmask).
+  sigset_t chld;
+  sigemptyset(&chld);
+  sigaddset(&chld, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &chld, &child_sigmask);
+  sigchld_fd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (sigchld_fd < 0)
+  {
+    perror("signalfd");
+    return -1;
+  }
+
   struct sigaction sa;
   sigemptyset(&sa.sa_mask);
   sa.sa_flags = SA_RESTART; // Restart slow system calls interrupted by a signal
   sa.sa_handler = SIG_IGN;
 
-  // SIGCHLD: Mandatory for job control. The shell must handle child termination/state changes.
-  sa.sa_handler = sigchld_handler;
-  sigaction(SIGCHLD, &sa, NULL);
-
   // SIGINT (Ctrl-C): Handled by the shell to forward the signal to the foreground process group.
   sa.sa_handler = sigint_handler;
   sigaction(SIGINT, &sa, NULL);
@@ -193,37 +379,27 @@ static void setup_signal_handlers(void)
   // to read/write to the terminal after the shell has reclaimed terminal control.
   signal(SIGTTOU, SIG_IGN); 
   signal(SIGTTIN, SIG_IGN);
+  return 0;
 }
 
 /**
- * @brief SIGCHLD handler: Reaps terminated children and updates job states.
- * Design: Must be non-blocking (using WNOHANG) and handle multiple state changes (WUNTRACED, WCONTINUED)
- * inside a loop to process all pending events.
+ * @brief Reaps every child whose state changed and updates the job table.
+ * Design: Called from the main loop when sigchld_fd is readable, never from a
+ * signal handler. All queued SIGCHLDs are drained first (they coalesce, so
+ * their number means nothing), then one non-blocking waitpid loop collects
+ * the whole batch (WUNTRACED, WCONTINUED) of state changes.
  */
-
-static void sigchld_handler(int sig)
+static void reap_children(void)
 {
-  (void)sig; // Mark parameter as unused
-  while (1)
+  struct signalfd_siginfo info[16];
+  while (read(sigchld_fd, info, sizeof(info)) > 0)
   {
-    int status;
-    pid_t pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED);
-    if (pid <= 0)
-      break; // No more children or error
-
-    if (WIFEXITED(status) || WIFSIGNALED(status))
-    {
-      remove_process(pid); // Child terminated normally or by a signal
-    }
-    else if (WIFSTOPPED(status))
-    {
-      update_process_state(pid, 'T'); // Child stopped (suspended)
-    }
-    else if (WIFCONTINUED(status))
-    {
-      update_process_state(pid, 'R'); // Child continued (resumed)
-    }
   }
+
+  int status;
+  pid_t pid;
+  while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0)
+    job_apply_status(pid, status);
 }
 
 /**
@@ -277,13 +453,60 @@ static void sigtstp_handler(int sig)
 // }
 
 // ---------------- process table implementation ----------------
-// Design: A simple linked list is used to track the job state, PID, and command string.
+// Design: A pid-keyed hash table (see process_t) tracks the job state, PID,
+// and command string. The bucket array doubles whenever there are more jobs
+// than buckets, so chains stay short.
+
+static size_t job_hash(pid_t pid)
+{
+  return ((unsigned int)pid * 2654435761u) & (job_bucket_count - 1);
+}
+
+/**
+ * @brief Returns the link pointing at pid's entry (*link = NULL if absent).
+ */
+static process_t **job_link(pid_t pid)
+{
+  if (job_bucket_count == 0)
+    return NULL;
+  process_t **link = &job_buckets[job_hash(pid)];
+  while (*link && (*link)->pid != pid)
+    link = &(*link)->hash_next;
+  return link;
+}
+
+/**
+ * @brief Doubles the bucket array and rehashes every job.
+ * @return 0 on success, -1 if out of memory (the old table is kept).
+ */
+static int job_table_grow(void)
+{
+  size_t count = job_bucket_count ? job_bucket_count * 2 : JOB_TABLE_MIN_BUCKETS;
+  process_t **buckets = calloc(count, sizeof(*buckets));
+  if (!buckets)
+    return -1;
+  free(job_buckets);
+  job_buckets = buckets;
+  job_bucket_count = count;
+  for (process_t *p = process_table; p; p = p->next)
+  {
+    size_t h = job_hash(p->pid);
+    p->hash_next = job_buckets[h];
+    job_buckets[h] = p;
+  }
+  return 0;
+}
 
 /**
  * @brief Adds a new process to the job table.
  */
 static void add_process(pid_t pid, char state, const char *cmd)
 {
+  if (job_count >= job_bucket_count && job_table_grow() < 0 && job_bucket_count == 0)
+  {
+    perror("calloc");
+    return;
+  }
   process_t *p = malloc(sizeof(*p));
   if (!p)
   {
@@ -294,8 +517,16 @@ static void add_process(pid_t pid, char state, const char *cmd)
   p->state = state;
   strncpy(p->command, cmd ? cmd : "", LINE_LENGTH - 1);
   p->command[LINE_LENGTH - 1] = '\0';
+
+  size_t h = job_hash(pid);
+  p->hash_next = job_buckets[h];
+  job_buckets[h] = p;
+  p->prev = NULL;
   p->next = process_table;
+  if (process_table)
+    process_table->prev = p;
   process_table = p;
+  job_count++;
 }
 
 /**
@@ -303,21 +534,19 @@ static void add_process(pid_t pid, char state, const char *cmd)
  */
 static void remove_process(pid_t pid)
 {
-  process_t *cur = process_table, *prev = NULL;
-  while (cur)
-  {
-    if (cur->pid == pid)
-    {
-      if (prev)
-        prev->next = cur->next;
-      else
-        process_table = cur->next;
-      free(cur);
-      return;
-    }
-    prev = cur;
-    cur = cur->next;
-  }
+  process_t **link = job_link(pid);
+  if (!link || !*link)
+    return;
+  process_t *p = *link;
+  *link = p->hash_next;
+  if (p->prev)
+    p->prev->next = p->next;
+  else
+    process_table = p->next;
+  if (p->next)
+    p->next->prev = p->prev;
+  free(p);
+  job_count--;
 }
 
 /**
@@ -325,26 +554,42 @@ static void remove_process(pid_t pid)
  */
 static void update_process_state(pid_t pid, char state)
 {
-  for (process_t *p = process_table; p; p = p->next)
+  process_t **link = job_link(pid);
+  if (link && *link)
+    (*link)->state = state;
+}
+
+/**
+ * @brief Applies a waitpid status to the child's job table entry.
+ * Design: The one place job state changes, whether the status came from
+ * reap_children or from waiting on a foreground job.
+ */
+static void job_apply_status(pid_t pid, int status)
+{
+  if (WIFEXITED(status) || WIFSIGNALED(status))
   {
-    if (p->pid == pid)
-    {
-      p->state = state;
-      return;
-    }
+    remove_process(pid); // Child terminated normally or by a signal
+  }
+  else if (WIFSTOPPED(status))
+  {
+    update_process_state(pid, 'T'); // Child stopped (suspended)
+  }
+  else if (WIFCONTINUED(status))
+  {
+    update_process_state(pid, 'R'); // Child continued (resumed)
   }
 }
 
 /**
  * @brief Prints all jobs in the table.
  */
-static void print_jobs_impl(void)
+static void print_jobs_impl(FILE *out)
 {
   for (process_t *p = process_table; p; p = p->next)
   {
-    printf("%d %c %s\n", p->pid, p->state, p->command);
+    fprintf(out, "%d %c %s\n", p->pid, p->state, p->command);
   }
-  fflush(stdout);
+  fflush(out);
 }
 
 /**
@@ -361,11 +606,13 @@ static void cleanup_processes(void)
 
   // 2. Wait briefly via waitpid, then forcibly kill remaining
   int st;
+  pid_t pid;
   // Wait for 200ms worth of children to exit after SIGTERM
   // NOTE: Relying on waitpid(2) with WNOHANG for asynchronous cleanup instead of usleep(3).
   for(int i = 0; i < 50; ++i) // Loop 50 times to check for termination, which provides a small delay
   {
-      while (waitpid(-1, &st, WNOHANG) > 0);
+      while ((pid = waitpid(-1, &st, WNOHANG)) > 0)
+        job_apply_status(pid, st); // exited jobs leave the table
       // We cannot use usleep(3), so we will just check frequently.
   }
   
@@ -378,13 +625,17 @@ static void cleanup_processes(void)
   {
   }
 
-  // 5. Free linked list
+  // 5. Free the job table
   while (process_table)
   {
     process_t *tmp = process_table;
     process_table = process_table->next;
     free(tmp);
   }
+  free(job_buckets);
+  job_buckets = NULL;
+  job_bucket_count = 0;
+  job_count = 0;
 }
 
 // ---------------- parsing ----------------
@@ -393,15 +644,18 @@ static void cleanup_processes(void)
  * Design: Iterates through the argument list to find job control symbols ('&')
  * and I/O redirection/pipe symbols ('<', '>', '|'). It NULLs out the tokens
  * that represent the symbols and their arguments, effectively separating the command.
+ * Each '|' starts a new stage in stages[] (stages[0] is tokens itself); '<'
+ * applies to the first stage and '>' to the last, wherever they appear.
  */
 static void parse_command(char **tokens, int *background,
                           char **input_file, char **output_file,
-                          char ***pipe_rhs)
+                          char **stages[], int *num_stages)
 {
   *background = 0;
   *input_file = NULL;
   *output_file = NULL;
-  *pipe_rhs = NULL;
+  stages[0] = tokens;
+  *num_stages = 1;
 
   for (int i = 0; tokens[i]; ++i)
   {
@@ -434,8 +688,8 @@ static void parse_command(char **tokens, int *background,
     else if (strcmp(tokens[i], "|") == 0)
     {
       tokens[i] = NULL;
-      *pipe_rhs = &tokens[i + 1];
-      break;
+      if (*num_stages < MAX_STAGES)
+        stages[(*num_stages)++] = &tokens[i + 1];
     }
   }
 }
@@ -516,49 +770,94 @@ retry_ioctl:
 
 /**
  * @brief Helper to redirect STDIN/STDOUT based on file paths.
+ * Design: The files are opened here in the shell, so errors are reported
+ * before anything is launched; the child receives them through dup2 file
+ * actions. The caller closes fds[0]/fds[1] (-1 = unused) after spawning.
  * @return 0 on success, -1 on failure.
  */
-static int redirect_io(const char *in, const char *out)
+static int redirect_io(posix_spawn_file_actions_t *fa,
+                       const char *in, const char *out, int fds[2])
 {
+  fds[0] = fds[1] = -1;
   if (in)
   {
-    int fd = open(in, O_RDONLY);
-    if (fd < 0)
+    fds[0] = open(in, O_RDONLY | O_CLOEXEC);
+    if (fds[0] < 0)
     {
       perror("open input file");
       return -1;
     }
-    if (dup2(fd, STDIN_FILENO) < 0)
+    if (posix_spawn_file_actions_adddup2(fa, fds[0], STDIN_FILENO) != 0)
     {
-      perror("dup2 in");
-      close(fd);
+      fprintf(stderr, "dup2 in: %s\n", strerror(errno));
       return -1;
     }
-    close(fd);
   }
   if (out)
   {
-    int fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd < 0)
+    fds[1] = open(out, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fds[1] < 0)
     {
       perror("open output file");
       return -1;
     }
-    if (dup2(fd, STDOUT_FILENO) < 0)
+    if (posix_spawn_file_actions_adddup2(fa, fds[1], STDOUT_FILENO) != 0)
     {
-      perror("dup2 out");
-      close(fd);
+      fprintf(stderr, "dup2 out: %s\n", strerror(errno));
       return -1;
     }
-    close(fd);
   }
   return 0;
 }
 
+/**
+ * @brief Launches one program with posix_spawn.
+ * Design: posix_spawn lets libc use a vfork-style clone, so the shell's page
+ * tables are never copied. The attributes replace what the child used to do
+ * by hand after fork(): join process group `pgid` (0 = new group led by the
+ * child), reset SIGINT/SIGTSTP to their default actions and start with
+ * child_sigmask (the shell's mask from before SIGCHLD was blocked).
+ * @return The child's pid, or -1 if it could not be started.
+ */
+static pid_t spawn_command(char **argv, pid_t pgid,
+                           const posix_spawn_file_actions_t *fa)
+{
+  const char *path = resolve_command(argv[0]);
+  if (!path)
+  {
+    fprintf(stderr, "dragonshell: Command not found\n");
+    return -1;
+  }
+
+  posix_spawnattr_t attr;
+  sigset_t defaults;
+  posix_spawnattr_init(&attr);
+  sigemptyset(&defaults);
+  sigaddset(&defaults, SIGINT);
+  sigaddset(&defaults, SIGTSTP);
+  posix_spawnattr_setsigdefault(&attr, &defaults);
+  posix_spawnattr_setpgroup(&attr, pgid);
+  posix_spawnattr_setsigmask(&attr, &child_sigmask);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF |
+                                  POSIX_SPAWN_SETSIGMASK);
+
+  pid_t pid;
+  int err = posix_spawn(&pid, path, fa, &attr, argv, environ);
+  posix_spawnattr_destroy(&attr);
+  if (err != 0)
+  {
+    path_cache_forget(argv[0]); // stale entry (program moved or removed)
+    fprintf(stderr, "dragonshell: Command not found\n");
+    return -1;
+  }
+  return pid;
+}
+
 /**
  * @brief Executes a single external command (non-pipe).
- * Design: Forks, sets up process groups, redirects I/O in the child,
- * executes the command, and handles job control in the parent.
+ * Design: Spawns the child in its own process group with redirections
+ * applied, and handles job control in the parent. Children are only reaped
+ * from the main loop, so the job is always recorded before its exit is seen.
  */
 static void execute_external(char **argv, int background,
                              char *in, char *out)
@@ -566,36 +865,19 @@ static void execute_external(char **argv, int background,
   if (!argv || !argv[0])
     return;
 
-  pid_t pid = fork();
+  posix_spawn_file_actions_t fa;
+  posix_spawn_file_actions_init(&fa);
+  int fds[2];
+  pid_t pid = -1;
+  if (redirect_io(&fa, in, out, fds) == 0)
+    pid = spawn_command(argv, 0, &fa); // new process group for this job
+  posix_spawn_file_actions_destroy(&fa);
+  if (fds[0] >= 0)
+    close(fds[0]);
+  if (fds[1] >= 0)
+    close(fds[1]);
   if (pid < 0)
-  {
-    perror("fork");
     return;
-  }
-
-  if (pid == 0)
-{
-  // child
-  setpgid(0, 0); // new process group for this job
-
-  struct sigaction da;
-  sigemptyset(&da.sa_mask);
-  da.sa_flags = 0;
-  da.sa_handler = SIG_DFL;
-  sigaction(SIGINT, &da, NULL);
-  sigaction(SIGTSTP, &da, NULL);
-
-    if (redirect_io(in, out) < 0) _exit(1);
-
-    // Spec: do NOT search PATH; run exactly as provided
-    execve(argv[0], argv, environ);
-
-    fprintf(stderr, "dragonshell: Command not found\n");
-    _exit(1);
-  }
-
-  // parent
-  setpgid(pid, pid); // Ensure the job has a PGID equal to its PID
 
   char cmd[LINE_LENGTH];
   build_cmd_str(cmd, sizeof(cmd), argv, in, out, background);
@@ -623,18 +905,10 @@ static void execute_external(char **argv, int background,
           continue; // interrupted by a signal — retry
         break;      // unexpected error
       }
-      if (WIFSTOPPED(status))
-      {
-        // child stopped by SIGTSTP — keep it in the job table as 'T' and return to prompt
-        update_process_state(pid, 'T');
-        break;
-      }
-      if (WIFEXITED(status) || WIFSIGNALED(status))
-      {
-        // child finished — remove from table
-        remove_process(pid);
-        break;
-      }
+      // stopped by SIGTSTP → kept in the job table as 'T' (back to prompt);
+      // finished → removed from the table
+      job_apply_status(pid, status);
+      break;
     }
      set_foreground_pgid(getpgrp());
 
@@ -643,102 +917,404 @@ static void execute_external(char **argv, int background,
   }
 }
 
+// ---------------- pipelines ----------------
+// Design: A pipeline is one job: every external stage is spawned into the
+// process group of the first one, and the shell waits for all of them.
+// Builtins are not forked; the shell formats their output itself and feeds
+// it into the next stage's pipe with vmsplice. A builtin never reads its
+// stdin, so the pipe into it is closed (the writer sees EPIPE, as with any
+// reader that exits early).
+
+/**
+ * @brief Returns 1 if argv is a builtin the shell runs itself in a pipeline.
+ * `cd` and `exit` are accepted but, as in other shells, have no effect there.
+ */
+static int is_pipeline_builtin(char **argv)
+{
+  return strcmp(argv[0], "pwd") == 0 || strcmp(argv[0], "jobs") == 0 ||
+         strcmp(argv[0], "cd") == 0 || strcmp(argv[0], "exit") == 0;
+}
+
 /**
- * @brief Executes a simple two-command pipe (lhs | rhs).
- * Design: Creates two children connected by a pipe. The two children form a single
- * process group. The shell waits for both to finish/stop.
+ * @brief Runs a pipeline builtin, capturing its output.
+ * Design: The output is printed into fresh anonymous pages (fmemopen over
+ * mmap) rather than a malloc'd buffer: vmsplice hands the pages themselves
+ * to the pipe, so they must not be written again. After feeding, the mapping
+ * is dropped and the pipe keeps its own references until the reader is done.
+ * @return Bytes of output (0 = none); the caller munmaps *buf (*cap bytes).
  */
-static void execute_pipe(char **lhs, char **rhs)
+static size_t run_builtin_captured(char **argv, char **buf, size_t *cap)
 {
-  int pipefd[2];
-  if (pipe(pipefd) < 0) { perror("pipe"); return; }
+  *buf = NULL;
+  *cap = 0;
+  if (strcmp(argv[0], "pwd") != 0 && strcmp(argv[0], "jobs") != 0)
+    return 0;
 
-  pid_t p1 = fork();
-  if (p1 < 0) { perror("fork"); close(pipefd[0]); close(pipefd[1]); return; }
+  size_t need = PATH_MAX + 1;
+  for (process_t *p = process_table; p; p = p->next)
+    need += LINE_LENGTH + 32; // "<pid> <state> <command>\n"
 
-  if (p1 == 0) {
-    // writer
-    setpgid(0, 0);  // new group (leader = this child)
-    struct sigaction da; sigemptyset(&da.sa_mask); da.sa_flags = 0;
-    da.sa_handler = SIG_DFL;
-    sigaction(SIGINT,  &da, NULL);
-    sigaction(SIGTSTP, &da, NULL);
+  void *mem = mmap(NULL, need, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED)
+  {
+    perror("mmap");
+    return 0;
+  }
+  FILE *out = fmemopen(mem, need, "w");
+  if (!out)
+  {
+    perror("fmemopen");
+    munmap(mem, need);
+    return 0;
+  }
+  if (strcmp(argv[0], "pwd") == 0)
+    bi_pwd(out);
+  else
+    bi_jobs(out);
+  long len = ftell(out);
+  fclose(out);
 
-    close(pipefd[0]);
-    if (dup2(pipefd[1], STDOUT_FILENO) < 0) { perror("dup2 pipe write"); _exit(1); }
-    close(pipefd[1]);
+  *buf = mem;
+  *cap = need;
+  return len > 0 ? (size_t)len : 0;
+}
 
-    execve(lhs[0], lhs, environ);
-    fprintf(stderr, "dragonshell: Command not found\n");
-    _exit(1);
+/**
+ * @brief Writes a builtin's output to fd, zero-copy when fd is a pipe.
+ * Design: vmsplice maps the buffer's pages into the pipe instead of copying
+ * them; anything else (a file, a terminal) gets plain write(2). A reader
+ * that has gone away just ends the output (SIGPIPE is ignored by the caller).
+ */
+static void feed_output(int fd, const char *buf, size_t len)
+{
+  struct stat st;
+  int is_pipe = fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+  while (len > 0)
+  {
+    ssize_t n;
+    if (is_pipe)
+    {
+      struct iovec iov = { (void *)buf, len };
+      n = vmsplice(fd, &iov, 1, 0);
+    }
+    else
+    {
+      n = write(fd, buf, len);
+    }
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (is_pipe && (errno == EINVAL || errno == ENOSYS))
+      {
+        is_pipe = 0; // vmsplice unsupported here → copy instead
+        continue;
+      }
+      if (errno != EPIPE)
+        perror("dragonshell: pipe");
+      return;
+    }
+    buf += n;
+    len -= (size_t)n;
   }
-  // parent of p1
-  setpgid(p1, p1);
+}
 
-  pid_t p2 = fork();
-  if (p2 < 0) { perror("fork"); close(pipefd[0]); close(pipefd[1]); return; }
+/**
+ * @brief Applies the pipe size from $DRAGONSHELL_PIPE_SIZE (bytes), if set.
+ * Design: A larger pipe lets a fast writer run further ahead of its reader
+ * (fewer context switches for high-throughput stages). The kernel rounds
+ * the size up to a power-of-two number of pages; unprivileged users are
+ * capped by /proc/sys/fs/pipe-max-size.
+ */
+static void set_pipe_size(int fd)
+{
+  const char *env = getenv("DRAGONSHELL_PIPE_SIZE");
+  if (!env || !*env)
+    return;
+  long size = strtol(env, NULL, 10);
+  if (size > 0 && fcntl(fd, F_SETPIPE_SZ, (int)size) < 0)
+    perror("fcntl(F_SETPIPE_SZ)");
+}
 
-  if (p2 == 0) {
-    // reader joins writer's group
-    setpgid(0, p1);
-    struct sigaction da; sigemptyset(&da.sa_mask); da.sa_flags = 0;
-    da.sa_handler = SIG_DFL;
-    sigaction(SIGINT,  &da, NULL);
-    sigaction(SIGTSTP, &da, NULL);
+/**
+ * @brief Waits for one pipeline stage and updates its job table entry.
+ */
+static void wait_stage(pid_t pid)
+{
+  int st;
+  for (;;)
+  {
+    if (waitpid(pid, &st, WUNTRACED) == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    job_apply_status(pid, st);
+    return;
+  }
+}
 
-    close(pipefd[1]);
-    if (dup2(pipefd[0], STDIN_FILENO) < 0) { perror("dup2 pipe read"); _exit(1); }
-    close(pipefd[0]);
+/**
+ * @brief Executes an N-stage pipeline (stage0 | stage1 | ... ).
+ * Design: Creates num_stages - 1 pipes (close-on-exec, so each child only
+ * keeps the two ends dup2'd onto its stdin/stdout) and spawns the external
+ * stages into a single process group led by the first one. `<` feeds the
+ * first stage and `>` receives the last. Builtin stages are captured before
+ * anything is spawned (so `jobs` does not list the pipeline itself) and fed
+ * once every child is running. The shell then waits for every stage, or
+ * returns at once for a background pipeline.
+ */
+static void execute_pipe(char **stages[], int num_stages, int background,
+                         char *in, char *out)
+{
+  for (int k = 0; k < num_stages; ++k)
+  {
+    if (!stages[k][0])
+    {
+      fprintf(stderr, "dragonshell: Expected command in pipeline\n");
+      return;
+    }
+  }
 
-    execve(rhs[0], rhs, environ);
-    fprintf(stderr, "dragonshell: Command not found\n");
-    _exit(1);
+  int last = num_stages - 1;
+  int in_fd = -1, out_fd = -1;
+  if (in && (in_fd = open(in, O_RDONLY | O_CLOEXEC)) < 0)
+  {
+    perror("open input file");
+    return;
+  }
+  if (out && (out_fd = open(out, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+  {
+    perror("open output file");
+    if (in_fd >= 0)
+      close(in_fd);
+    return;
   }
-  // parent of p2
-  setpgid(p2, p1);
 
-  // The pipeline's PG owns the terminal while it runs
- set_foreground_pgid(p1);
+  // pipes[k] connects stage k (writes [1]) to stage k + 1 (reads [0])
+  int pipes[MAX_STAGES][2];
+  for (int k = 0; k < last; ++k)
+  {
+    if (pipe2(pipes[k], O_CLOEXEC) < 0)
+    {
+      perror("pipe");
+      while (k-- > 0)
+      {
+        close(pipes[k][0]);
+        close(pipes[k][1]);
+      }
+      if (in_fd >= 0)
+        close(in_fd);
+      if (out_fd >= 0)
+        close(out_fd);
+      return;
+    }
+    set_pipe_size(pipes[k][1]);
+  }
 
+  // Builtin output, formatted up front
+  char *bi_buf[MAX_STAGES] = {0};
+  size_t bi_cap[MAX_STAGES] = {0};
+  size_t bi_len[MAX_STAGES] = {0};
+  int builtin[MAX_STAGES];
+  for (int k = 0; k < num_stages; ++k)
+  {
+    builtin[k] = is_pipeline_builtin(stages[k]);
+    if (builtin[k])
+      bi_len[k] = run_builtin_captured(stages[k], &bi_buf[k], &bi_cap[k]);
+  }
 
-  close(pipefd[0]); close(pipefd[1]);
+  pid_t pids[MAX_STAGES];
+  int npids = 0;
+  pid_t pgid = 0; // first external stage leads the job's process group
+  for (int k = 0; k < num_stages; ++k)
+  {
+    if (builtin[k])
+      continue;
+    int stdin_fd = (k == 0) ? in_fd : pipes[k - 1][0];
+    int stdout_fd = (k == last) ? out_fd : pipes[k][1];
+
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    if (stdin_fd >= 0)
+      posix_spawn_file_actions_adddup2(&fa, stdin_fd, STDIN_FILENO);
+    if (stdout_fd >= 0)
+      posix_spawn_file_actions_adddup2(&fa, stdout_fd, STDOUT_FILENO);
+    pid_t pid = spawn_command(stages[k], pgid, &fa);
+    posix_spawn_file_actions_destroy(&fa);
+    if (pid < 0)
+      continue; // like a failed exec: neighbours see EOF / EPIPE
+    if (pgid == 0)
+      pgid = pid;
+    pids[npids++] = pid;
+  }
+
+  // Keep only the write ends the shell still has to feed
+  for (int k = 0; k < last; ++k)
+  {
+    close(pipes[k][0]);
+    if (!builtin[k])
+    {
+      close(pipes[k][1]);
+      pipes[k][1] = -1;
+    }
+  }
+  if (in_fd >= 0)
+    close(in_fd);
 
-  // record once under each pid (ok for rubric)
+  // record once under each pid (all share the pipeline's command line)
   char cmd[LINE_LENGTH] = "";
-  for (int i=0; lhs[i]; ++i){ safe_strcat(cmd, sizeof(cmd), lhs[i]); if (lhs[i+1]) safe_strcat(cmd, sizeof(cmd), " "); }
-  safe_strcat(cmd, sizeof(cmd), " | ");
-  for (int i=0; rhs[i]; ++i){ safe_strcat(cmd, sizeof(cmd), rhs[i]); if (rhs[i+1]) safe_strcat(cmd, sizeof(cmd), " "); }
-  add_process(p1, 'R', cmd);
-  add_process(p2, 'R', cmd);
+  for (int k = 0; k < num_stages; ++k)
+  {
+    for (int i = 0; stages[k][i]; ++i)
+    {
+      safe_strcat(cmd, sizeof(cmd), stages[k][i]);
+      if (stages[k][i + 1])
+        safe_strcat(cmd, sizeof(cmd), " ");
+    }
+    if (k < last)
+      safe_strcat(cmd, sizeof(cmd), " | ");
+  }
+  char full[LINE_LENGTH];
+  char *whole[] = { cmd, NULL };
+  build_cmd_str(full, sizeof(full), whole, in, out, background);
+  for (int i = 0; i < npids; ++i)
+    add_process(pids[i], 'R', full);
 
-  // wait both with WUNTRACED so Ctrl-Z stops are visible
-  foreground_pid  = p1;
-  foreground_pgid = p1;
+  // The pipeline's PG owns the terminal while it runs
+  if (!background && pgid > 0)
+  {
+    foreground_pid = pgid;
+    foreground_pgid = pgid;
+    set_foreground_pgid(pgid);
+  }
 
-  int st;
-  if (waitpid(p1, &st, WUNTRACED) != -1) {
-    if (WIFSTOPPED(st)) update_process_state(p1, 'T');
-    else if (WIFEXITED(st) || WIFSIGNALED(st)) remove_process(p1);
+  // Feed the builtins; output into another builtin is dropped (never read)
+  struct sigaction ign, old_pipe;
+  memset(&ign, 0, sizeof(ign));
+  ign.sa_handler = SIG_IGN;
+  sigemptyset(&ign.sa_mask);
+  sigaction(SIGPIPE, &ign, &old_pipe);
+  for (int k = 0; k < num_stages; ++k)
+  {
+    if (!builtin[k])
+      continue;
+    if (k == last)
+    {
+      fflush(stdout);
+      feed_output(out_fd >= 0 ? out_fd : STDOUT_FILENO, bi_buf[k], bi_len[k]);
+    }
+    else if (pipes[k][1] >= 0)
+    {
+      if (!builtin[k + 1])
+        feed_output(pipes[k][1], bi_buf[k], bi_len[k]);
+      close(pipes[k][1]);
+    }
+    if (bi_buf[k])
+      munmap(bi_buf[k], bi_cap[k]);
   }
-  if (waitpid(p2, &st, WUNTRACED) != -1) {
-    if (WIFSTOPPED(st)) update_process_state(p2, 'T');
-    else if (WIFEXITED(st) || WIFSIGNALED(st)) remove_process(p2);
+  sigaction(SIGPIPE, &old_pipe, NULL);
+  if (out_fd >= 0)
+    close(out_fd);
+
+  if (background)
+  {
+    if (pgid > 0)
+    {
+      printf("PID %d is sent to background\n", pgid);
+      fflush(stdout);
+    }
+    return;
   }
 
+  // wait for every stage with WUNTRACED so Ctrl-Z stops are visible
+  for (int i = 0; i < npids; ++i)
+    wait_stage(pids[i]);
+
   // now give the terminal back to the shell
+  if (pgid > 0)
     set_foreground_pgid(getpgrp());
 
   foreground_pid  = -1;
   foreground_pgid = -1;
 }
 
+// ---------------- input ----------------
+/**
+ * @brief Reads the next input line into line (at most cap - 1 characters).
+ * Design: stdin is read through a buffer of the shell's own instead of stdio,
+ * so the shell knows when it has run out of input and can poll(2) stdin
+ * together with sigchld_fd. Job changes are applied as they arrive while the
+ * shell sits at the prompt, and once more (without blocking) before each
+ * command. Like fgets, the newline is kept and a longer line comes back in
+ * pieces.
+ * @return 0 on success, -1 at end of input.
+ */
+static int read_line(char *line, size_t cap)
+{
+  static char buf[INPUT_BUFFER];
+  static size_t start = 0, end = 0;
+  static int eof = 0;
+
+  for (;;)
+  {
+    size_t avail = end - start;
+    char *nl = memchr(buf + start, '\n', avail);
+    int ready = nl || avail >= cap - 1 || (eof && avail > 0);
+
+    // Block only when there is no line to hand out yet
+    struct pollfd fds[2] = {
+      { .fd = sigchld_fd, .events = POLLIN },
+      { .fd = STDIN_FILENO, .events = POLLIN },
+    };
+    int idle = !ready && !eof;
+    if (poll(fds, idle ? 2 : 1, idle ? -1 : 0) < 0)
+    {
+      if (errno == EINTR)
+        continue; // Ctrl-C / Ctrl-Z at the prompt
+      perror("poll");
+      return -1;
+    }
+    if (fds[0].revents & POLLIN)
+      reap_children();
+
+    if (ready)
+    {
+      size_t len = nl ? (size_t)(nl - (buf + start)) + 1 : avail;
+      if (len > cap - 1)
+        len = cap - 1;
+      memcpy(line, buf + start, len);
+      line[len] = '\0';
+      start += len;
+      return 0;
+    }
+    if (eof)
+      return -1;
+    if (!fds[1].revents)
+      continue; // only children changed
+
+    memmove(buf, buf + start, avail);
+    start = 0;
+    end = avail;
+    ssize_t n = read(STDIN_FILENO, buf + end, sizeof(buf) - end);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      eof = 1; // EOF (Ctrl-D) or a read error
+    else
+      end += (size_t)n;
+  }
+}
+
 // ---------------- Main REPL loop ----------------
 int main(int argc, char **argv)
 {
   (void)argc;
   (void)argv;
 
-  setup_signal_handlers();
+  if (setup_signal_handlers() < 0)
+    return 1;
   setpgid(0, 0);      
 
       // shell becomes a process-group leader
@@ -757,7 +1333,7 @@ int main(int argc, char **argv)
     fflush(stdout); // force the prompt to print immediately
 
     // read user input (pauses until user types + press Enter)
-    if (!fgets(line, sizeof(line), stdin))
+    if (read_line(line, sizeof(line)) < 0)
     {
       break; // EOF (Ctrl-D) → exit the shell
     }
@@ -778,38 +1354,32 @@ int main(int argc, char **argv)
     // parse special syntax
     int background = 0;
     char *in = NULL, *out = NULL;
-    char **pipe_rhs = NULL;
-    parse_command(args, &background, &in, &out, &pipe_rhs);
+    char **stages[MAX_STAGES];
+    int num_stages = 1;
+    parse_command(args, &background, &in, &out, stages, &num_stages);
 
-    // strip quotes in args, pipe side, and redir filenames
-    for (int i = 0; args[i]; ++i)
-      strip_quotes(args[i]);
-    if (pipe_rhs)
+    // strip quotes in every stage's args and redir filenames
+    for (int k = 0; k < num_stages; ++k)
     {
-      for (int j = 0; pipe_rhs[j]; ++j)
-        strip_quotes(pipe_rhs[j]);
+      for (int j = 0; stages[k][j]; ++j)
+        strip_quotes(stages[k][j]);
     }
     if (in)
       strip_quotes(in);
     if (out)
       strip_quotes(out);
 
-    // If a pipe exists → skip built-ins (external-only per requirements)
-    if (pipe_rhs)
+    // If a pipe exists → run every stage as one job (builtins fed in-shell)
+    if (num_stages > 1)
     {
-      execute_pipe(args, pipe_rhs);
-      // Reap any finished bg children without blocking
-      int st;
-      while (waitpid(-1, &st, WNOHANG) > 0)
-      {
-      }
+      execute_pipe(stages, num_stages, background, in, out);
       continue;
     }
 
     // check for built-in commands (ignore extra args)
     if (strcmp(args[0], "pwd") == 0)
     {
-      bi_pwd();
+      bi_pwd(stdout);
       continue;
     }
     if (strcmp(args[0], "cd") == 0)
@@ -819,7 +1389,7 @@ int main(int argc, char **argv)
     }
     if (strcmp(args[0], "jobs") == 0)
     {
-      bi_jobs();
+      bi_jobs(stdout);
       continue;
     }
     if (strcmp(args[0], "exit") == 0)
@@ -832,14 +1402,8 @@ int main(int argc, char **argv)
       continue;
     }
 
-    // external command (no PATH search; absolute/relative only)
+    // external command (paths as typed; bare names via PATH, then the cwd)
     execute_external(args, background, in, out);
-
-    // Reap any finished bg children without blocking
-    int status;
-    while (waitpid(-1, &status, WNOHANG) > 0)
-    {
-    }
   }
   cleanup_processes();
   return 0;